@@ -1,15 +1,20 @@
+// Generated by protoc-gen-lpmpp.  DO NOT EDIT!
+// source: vuln.proto, root: vuln.fuzz.RPCCall, encoder: stream
+
 #include <string>
 #include <sstream>
 
 #include "mutator.hh"
-#include "proto/vuln.pb.h"
-#include "nlohmann/json.hpp"
+#include "proto/vuln.lpmpp.hh"
 #include "convert/convert.hh"
 
-namespace fuzz = vuln::fuzz;
-namespace json = nlohmann::detail;
+using Root = ::vuln::fuzz::RPCCall;
 
-std::vector<char> OutputBuffer;
+static void Encode(const Root &proto, std::string &out) {
+  std::stringstream stream;
+  stream << proto;
+  out = stream.str();
+}
 
 extern "C" {
 
@@ -25,11 +30,25 @@ std::size_t afl_custom_fuzz(lpmpp::MutatorState *state, unsigned char *buf,
   std::size_t buf_size, unsigned char **outbuf, unsigned char *addbuf, 
   std::size_t addbuf_size, std::size_t max_size) {
   
-  return lpmpp::fuzz<fuzz::RPCCall>(state, buf, buf_size, outbuf, addbuf, addbuf_size, max_size);
+  return lpmpp::fuzz<Root>(state, buf, buf_size, outbuf, addbuf, addbuf_size, max_size);
 }
 
 int afl_custom_init_trim(lpmpp::MutatorState *state, unsigned char *buf, std::size_t buf_size) {
-  return lpmpp::init_trim<fuzz::RPCCall>(state, buf, buf_size);
+  return lpmpp::init_trim<Root>(state, buf, buf_size);
+}
+
+std::size_t afl_custom_havoc_mutation(lpmpp::MutatorState *state, unsigned char *buf, 
+  std::size_t buf_size, unsigned char **out_buf, std::size_t max_size) {
+  
+  return lpmpp::havoc_mutation<Root>(state, buf, buf_size, out_buf, max_size);
+}
+
+uint8_t afl_custom_havoc_mutation_probability(lpmpp::MutatorState *state) {
+  return lpmpp::havoc_mutation_probability(state);
+}
+
+void afl_custom_splice_optout(lpmpp::MutatorState *state) {
+  lpmpp::splice_optout(state);
 }
 
 std::size_t afl_custom_trim(lpmpp::MutatorState *state, unsigned char **outbuf) {
@@ -40,30 +59,32 @@ int afl_custom_post_trim(lpmpp::MutatorState *state, unsigned char success) {
   return lpmpp::post_trim(state, success);
 }
 
-std::size_t afl_custom_post_process(lpmpp::MutatorState *state, unsigned char *buf, 
-  std::size_t buf_size, char **outbuf) {
+uint8_t afl_custom_queue_new_entry(lpmpp::MutatorState *state, const uint8_t *filename_new, 
+  const uint8_t *filename_orig) {
   
-  fuzz::RPCCall proto;
+  return lpmpp::queue_new_entry<Root>(state, filename_new, filename_orig);
+}
 
-  if (!proto.ParseFromArray(buf, buf_size)) {
-    *outbuf = nullptr;
-    return 0;
-  }
+uint8_t afl_custom_queue_get(lpmpp::MutatorState *state, const uint8_t *filename) {
+  return lpmpp::queue_get<Root>(state, filename);
+}
 
-  std::stringstream stream;
-  stream << proto;
-  const std::string str = stream.str();
+const char *afl_custom_describe(lpmpp::MutatorState *state, std::size_t max_description_len) {
+  return lpmpp::describe(state, max_description_len);
+}
 
-  if (OutputBuffer.size() < str.size()) {
-    OutputBuffer.clear();
-    OutputBuffer.resize(str.size());
-  }
+const char *afl_custom_introspection(lpmpp::MutatorState *state) {
+  return lpmpp::introspection(state);
+}
 
-  char *out = OutputBuffer.data();
-  memcpy(out, str.c_str(), str.size());
-  *outbuf = out;
-  return str.size();
+void afl_custom_post_run(lpmpp::MutatorState *state) {
+  lpmpp::post_run(state);
+}
 
+std::size_t afl_custom_post_process(lpmpp::MutatorState *state, unsigned char *buf, 
+  std::size_t buf_size, unsigned char **outbuf) {
+  
+  return lpmpp::post_process<Root>(state, buf, buf_size, outbuf, Encode);
 }
 
-}
\ No newline at end of file
+}
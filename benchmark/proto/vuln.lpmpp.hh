@@ -0,0 +1,83 @@
+// Generated by protoc-gen-lpmpp.  DO NOT EDIT!
+// source: vuln.proto
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <google/protobuf/descriptor.h>
+
+#include "vuln.pb.h"
+#include "visitor.hh"
+
+namespace lpmpp {
+
+template<>
+struct MessageTraits<::vuln::fuzz::RPCArgument> {
+  static constexpr bool kSpecialized = true;
+  static constexpr int kFieldCount = 5;
+  static constexpr std::array<FieldLayout, 5> kFields = {{
+    {1, ::google::protobuf::FieldDescriptor::TYPE_BYTES, false, -1},
+    {2, ::google::protobuf::FieldDescriptor::TYPE_BYTES, false, 0},
+    {3, ::google::protobuf::FieldDescriptor::TYPE_UINT64, false, 0},
+    {4, ::google::protobuf::FieldDescriptor::TYPE_BOOL, false, 0},
+    {5, ::google::protobuf::FieldDescriptor::TYPE_DOUBLE, false, 0},
+  }};
+
+  static const ::google::protobuf::FieldDescriptor * Field(int index) {
+    static const ::google::protobuf::Descriptor *desc = ::vuln::fuzz::RPCArgument::descriptor();
+    return desc->field(index);
+  }
+
+  template<typename V>
+  static void Visit(::vuln::fuzz::RPCArgument &msg, V &v) {
+    if (msg.has_key()) {
+      v.String(Field(0), *msg.mutable_key());
+    }
+    if (msg.has_vstr()) {
+      v.String(Field(1), *msg.mutable_vstr());
+    }
+    if (msg.has_vint()) {
+      v.Value(Field(2), msg.vint(), [&msg](uint64_t x) {
+        msg.set_vint(x);
+      });
+    }
+    if (msg.has_vbool()) {
+      v.Value(Field(3), msg.vbool(), [&msg](bool x) {
+        msg.set_vbool(x);
+      });
+    }
+    if (msg.has_vfloat()) {
+      v.Value(Field(4), msg.vfloat(), [&msg](double x) {
+        msg.set_vfloat(x);
+      });
+    }
+  }
+};
+
+template<>
+struct MessageTraits<::vuln::fuzz::RPCCall> {
+  static constexpr bool kSpecialized = true;
+  static constexpr int kFieldCount = 2;
+  static constexpr std::array<FieldLayout, 2> kFields = {{
+    {1, ::google::protobuf::FieldDescriptor::TYPE_BYTES, false, -1},
+    {2, ::google::protobuf::FieldDescriptor::TYPE_MESSAGE, true, -1},
+  }};
+
+  static const ::google::protobuf::FieldDescriptor * Field(int index) {
+    static const ::google::protobuf::Descriptor *desc = ::vuln::fuzz::RPCCall::descriptor();
+    return desc->field(index);
+  }
+
+  template<typename V>
+  static void Visit(::vuln::fuzz::RPCCall &msg, V &v) {
+    if (msg.has_op()) {
+      v.String(Field(0), *msg.mutable_op());
+    }
+    for (int i = 0; i < msg.args_size(); i++) {
+      v.Message(Field(1), *msg.mutable_args(i));
+    }
+  }
+};
+
+}
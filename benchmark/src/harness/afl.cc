@@ -9,8 +9,8 @@
 
 extern "C" {
 
-int LLVMFuzzerTestOneInput(const char *Data, std::size_t Size) {
-  std::string payload(Data, Size);
+int LLVMFuzzerTestOneInput(const uint8_t *Data, std::size_t Size) {
+  std::string payload(reinterpret_cast<const char *>(Data), Size);
   vuln::RPCEntry(payload);
   return 0;
 }
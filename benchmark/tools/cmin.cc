@@ -0,0 +1,22 @@
+/**
+ * lpmpp-cmin for the vuln benchmark, links the AFL++ harness in-process
+ */
+
+#include <sstream>
+#include <string>
+
+#include "cmin.hh"
+#include "proto/vuln.pb.h"
+#include "convert/convert.hh"
+
+namespace fuzz = vuln::fuzz;
+
+static std::string Encode(const fuzz::RPCCall &proto) {
+  std::stringstream stream;
+  stream << proto;
+  return stream.str();
+}
+
+int main(int argc, char **argv) {
+  return lpmpp::CminMain<fuzz::RPCCall>(argc, argv, Encode);
+}
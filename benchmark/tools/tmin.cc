@@ -0,0 +1,22 @@
+/**
+ * lpmpp-tmin for the vuln benchmark, links the AFL++ harness in-process
+ */
+
+#include <sstream>
+#include <string>
+
+#include "tmin.hh"
+#include "proto/vuln.pb.h"
+#include "convert/convert.hh"
+
+namespace fuzz = vuln::fuzz;
+
+static std::string Encode(const fuzz::RPCCall &proto) {
+  std::stringstream stream;
+  stream << proto;
+  return stream.str();
+}
+
+int main(int argc, char **argv) {
+  return lpmpp::TminMain<fuzz::RPCCall>(argc, argv, Encode);
+}
@@ -0,0 +1,56 @@
+#include <algorithm>
+#include <cmath>
+
+#include "bloat.hh"
+
+namespace lpmpp {
+
+/* -------------------------------------- */
+/* --- SlidingSketch method definitions - */
+/* -------------------------------------- */
+
+std::size_t SlidingSketch::Quantile(double q) const {
+  uint64_t total = 0;
+  for (const SizeHistogram &window : windows)
+    total += window.size();
+
+  if (total == 0)
+    return 0;
+
+  const uint64_t rank = std::ceil(q * total);
+  uint64_t seen = 0;
+
+  for (int bucket = 0; bucket < kSketchBuckets; bucket++) {
+    for (const SizeHistogram &window : windows)
+      seen += window.count(bucket);
+
+    if (seen >= rank)
+      return SizeHistogram::Lower(bucket);
+  }
+
+  return SizeHistogram::Lower(kSketchBuckets - 1);
+}
+
+/* -------------------------------------- */
+/* --- BloatDetector method definitions - */
+/* -------------------------------------- */
+
+bool BloatDetector::Update() {
+  // The first window of each sets its baseline
+  if (mutant_base == 0 && mutants.windows_completed() > 0)
+    mutant_base = std::max<std::size_t>(1, mutants.Quantile(kBloatQuantile));
+
+  if (entry_base == 0 && entries.windows_completed() > 0)
+    entry_base = std::max<std::size_t>(1, entries.Quantile(kBloatQuantile));
+
+  if (mutant_base == 0)
+    return false;
+
+  drift_ = static_cast<double>(mutants.Quantile(kBloatQuantile)) / mutant_base;
+  if (entry_base != 0)
+    drift_ = std::max(drift_, static_cast<double>(entries.Quantile(kBloatQuantile)) / entry_base);
+
+  return true;
+}
+
+}
@@ -0,0 +1,226 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+
+#include "queue.hh"
+
+namespace lpmpp {
+
+// Buckets per doubling of the size, bounding the relative error to 1/8
+static const int kSketchSubBuckets = 8;
+static const int kSketchBuckets = 64 * kSketchSubBuckets;
+// Windows of a sliding sketch, the oldest is dropped as a new one starts
+static const int kSketchWindows = 4;
+// Samples per window for mutants and for queue entries
+static const uint32_t kBloatMutantWindow = 1 << 14;
+static const uint32_t kBloatEntryWindow = 1 << 8;
+// Quantile of the sizes compared to the first window
+static const double kBloatQuantile = 0.9;
+// Growth of the quantile over the first window at which messages are bloated
+static const double kBloatDrift = 2.0;
+// Highest weight of deletions relative to the scheduler
+static const double kBloatMaxBias = 4.0;
+
+
+/**
+ * @brief Histogram of sizes in logarithmic buckets, each doubling of the
+ * size is split into kSketchSubBuckets buckets
+ * 
+ */
+class SizeHistogram {
+private:
+  uint32_t counts[kSketchBuckets] = {};
+  uint64_t total = 0;
+
+public:
+  void Add(std::size_t size) {
+    counts[Bucket(size)]++;
+    total++;
+  }
+
+  void Clear() {
+    std::fill(std::begin(counts), std::end(counts), 0);
+    total = 0;
+  }
+
+  uint32_t count(int bucket) const {
+    return counts[bucket];
+  }
+
+  uint64_t size() const {
+    return total;
+  }
+
+  static int Bucket(std::size_t size) {
+    if (size < kSketchSubBuckets)
+      return size;
+
+    const int e = std::bit_width(size) - 1;
+    return (e - 2) * kSketchSubBuckets + ((size >> (e - 3)) & (kSketchSubBuckets - 1));
+  }
+
+  /**
+   * @brief returns the smallest size in `bucket`
+   * 
+   */
+  static std::size_t Lower(int bucket) {
+    if (bucket < kSketchSubBuckets)
+      return bucket;
+
+    const int e = bucket / kSketchSubBuckets + 2;
+    return static_cast<std::size_t>(kSketchSubBuckets + bucket % kSketchSubBuckets) << (e - 3);
+  }
+};
+
+
+/**
+ * @brief Quantiles of the last kSketchWindows windows of sizes, in
+ * constant memory
+ * 
+ */
+class SlidingSketch {
+private:
+  SizeHistogram windows[kSketchWindows];
+  uint32_t window_size;
+  int head = 0;
+  uint64_t windows_done = 0;
+
+public:
+  SlidingSketch(uint32_t window_size) : window_size(window_size) {}
+
+  /**
+   * @brief Adds a size, returns true if it completed a window
+   * 
+   */
+  bool Add(std::size_t size) {
+    windows[head].Add(size);
+    if (windows[head].size() < window_size)
+      return false;
+
+    head = (head + 1) % kSketchWindows;
+    windows[head].Clear();
+    windows_done++;
+    return true;
+  }
+
+  /**
+   * @brief returns the `q` quantile of the sizes in the window
+   * 
+   */
+  std::size_t Quantile(double q) const;
+
+  /**
+   * @brief returns the number of windows completed
+   * 
+   */
+  uint64_t windows_completed() const {
+    return windows_done;
+  }
+};
+
+
+/**
+ * @brief Detects that mutants or queue entries grow over the campaign. The
+ * kBloatQuantile quantile of their sizes is compared to that of the first
+ * window. Once either has grown kBloatDrift times, mutants are kept below
+ * kBloatDrift times the first quantile, deletions are weighted up and
+ * larger entries are trimmed again.
+ * 
+ */
+class BloatDetector {
+private:
+  SlidingSketch mutants{kBloatMutantWindow};
+  SlidingSketch entries{kBloatEntryWindow};
+  // Quantiles of the first windows
+  std::size_t mutant_base = 0;
+  std::size_t entry_base = 0;
+  double drift_ = 1.0;
+  HashIndex<bool> retrimmed;
+
+public:
+  /**
+   * @brief Records the size of a mutant, returns true if the drift was
+   * recomputed
+   * 
+   */
+  bool Mutant(std::size_t size) {
+    return mutants.Add(size) && Update();
+  }
+
+  /**
+   * @brief Records the size of a new queue entry, returns true if the drift
+   * was recomputed
+   * 
+   */
+  bool Entry(std::size_t size) {
+    return entries.Add(size) && Update();
+  }
+
+  bool bloated() const {
+    return drift_ >= kBloatDrift;
+  }
+
+  /**
+   * @brief returns how many times the sizes have grown since the start
+   * 
+   */
+  double drift() const {
+    return drift_;
+  }
+
+  /**
+   * @brief returns the largest mutant of an entry of `entry_size` bytes:
+   * no larger than the entry once bloated, unless below the bloat threshold
+   * 
+   */
+  std::size_t SizeBudget(std::size_t entry_size, std::size_t max_size) const {
+    if (!bloated())
+      return max_size;
+
+    return std::min(max_size, std::max(entry_size, Threshold()));
+  }
+
+  /**
+   * @brief returns the factor by which deletions are weighted up
+   * 
+   */
+  double DeleteBias() const {
+    return bloated() ? std::min(drift_, kBloatMaxBias) : 1.0;
+  }
+
+  /**
+   * @brief returns true if an entry of `size` bytes is above the bloat
+   * threshold
+   * 
+   */
+  bool Bloated(std::size_t size) const {
+    return bloated() && size > Threshold();
+  }
+
+  /**
+   * @brief returns true the first time it is called for `entry`, the hash
+   * of the name of a bloated entry
+   * 
+   */
+  bool Retrim(uint64_t entry) {
+    bool &done = retrimmed.Insert(entry, false);
+    if (done)
+      return false;
+
+    done = true;
+    return true;
+  }
+
+private:
+  std::size_t Threshold() const {
+    return kBloatDrift * mutant_base;
+  }
+
+  bool Update();
+};
+
+}
@@ -0,0 +1,238 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <queue>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <google/protobuf/message.h>
+
+#include "corpus.hh"
+#include "harness.hh"
+#include "utils.hh"
+
+namespace lpmpp {
+
+static const char * const kCminUsage = 
+  "Usage: %s [-j jobs] [-t timeout] [-v] <in_dir> <out_dir>\n"
+  "\n"
+  "Selects a minimal subset of the messages in in_dir which covers the same\n"
+  "edges of the linked harness. Text format inputs (*.txt) are written to\n"
+  "out_dir in binary format.\n"
+  "\n"
+  "  -j jobs       number of worker processes (default: number of cores)\n"
+  "  -t timeout    per input timeout in seconds (default: 10)\n"
+  "  -v            keep the output of the harness\n";
+
+
+/**
+ * @brief Edges hit by a corpus input, as written by workers 
+ * 
+ */
+struct CoverageRecord {
+  uint64_t index;
+  uint32_t nedges;
+};
+
+
+/**
+ * @brief Greedy set cover over the edge sets of the corpus. Repeatedly picks
+ * the input covering the most uncovered edges, preferring smaller inputs. 
+ * Gains only decrease, so stale gains are re-evaluated lazily.
+ * 
+ * @param edges the sorted edge set of each input
+ * @param sizes the size of each input, used to break ties
+ * @param nedges the total number of edges
+ * @return the indexes of the selected inputs
+ */
+inline std::vector<std::size_t> SetCover(const std::vector<std::vector<uint32_t>> &edges,
+  const std::vector<std::uintmax_t> &sizes, std::size_t nedges) {
+
+  std::vector<uint64_t> covered((nedges + 63) / 64, 0);
+  std::vector<std::size_t> selected;
+
+  auto gain = [&](std::size_t i) {
+    std::size_t n = 0;
+    for (uint32_t e : edges[i]) {
+      n += (covered[e / 64] >> (e % 64)) & 1 ? 0 : 1;
+    }
+    return n;
+  };
+
+  typedef std::pair<std::size_t, std::size_t> Entry;
+  auto cmp = [&](const Entry &a, const Entry &b) {
+    if (a.first != b.first)
+      return a.first < b.first;
+    return sizes[a.second] > sizes[b.second];
+  };
+
+  std::priority_queue<Entry, std::vector<Entry>, decltype(cmp)> queue(cmp);
+  for (std::size_t i = 0; i < edges.size(); i++) {
+    if (!edges[i].empty())
+      queue.push(Entry(edges[i].size(), i));
+  }
+
+  while (!queue.empty()) {
+    Entry top = queue.top();
+    queue.pop();
+
+    const std::size_t current = gain(top.second);
+    if (current == 0)
+      continue;
+
+    if (current < top.first) {
+      queue.push(Entry(current, top.second));
+      continue;
+    }
+
+    for (uint32_t e : edges[top.second]) {
+      covered[e / 64] |= uint64_t(1) << (e % 64);
+    }
+    selected.push_back(top.second);
+  }
+
+  std::sort(selected.begin(), selected.end());
+  return selected;
+}
+
+
+/**
+ * @brief Entry point for lpmpp-cmin, replays every input of a corpus 
+ * directory through the linked harness across a pool of forked workers and
+ * copies a minimal covering subset to the output directory.
+ * 
+ * @param argc argument count from main
+ * @param argv arguments from main
+ * @param encoder the post_process encoder used by the campaign, or nullptr
+ */
+template<Derived<google::protobuf::Message> T>
+int CminMain(int argc, char **argv, typename Harness<T>::Encoder encoder) {
+  unsigned jobs = std::thread::hardware_concurrency();
+  unsigned timeout = 10;
+  bool verbose = false;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "j:t:v")) != -1) {
+    switch (opt) {
+      case 'j': jobs = std::strtoul(optarg, nullptr, 10); break;
+      case 't': timeout = std::strtoul(optarg, nullptr, 10); break;
+      case 'v': verbose = true; break;
+      default:
+        fprintf(stderr, kCminUsage, argv[0]);
+        return 1;
+    }
+  }
+
+  if (argc - optind != 2) {
+    fprintf(stderr, kCminUsage, argv[0]);
+    return 1;
+  }
+
+  const std::filesystem::path indir(argv[optind]);
+  const std::filesystem::path outdir(argv[optind + 1]);
+  std::filesystem::create_directories(outdir);
+
+  const std::vector<std::filesystem::path> inputs = ListCorpus(indir);
+
+  Harness<T> harness(std::move(encoder));
+  harness.Init(&argc, &argv);
+
+  google::protobuf::LogSilencer silencer;
+  WorkerPool pool(jobs, timeout, !verbose);
+
+  // Each worker appends its records to its own file, with one write per
+  // record so that a crash cannot leave a partial record behind
+
+  std::vector<std::FILE *> records;
+  for (unsigned k = 0; k < pool.size(); k++) {
+    std::FILE *f = std::tmpfile();
+    if (!f) {
+      std::cerr << "[-] Failed to create temporary file\n";
+      return 1;
+    }
+    records.push_back(f);
+  }
+
+  std::vector<std::size_t> failures = pool.Run(inputs.size(), 
+    [&](std::size_t index, unsigned worker) {
+      T proto;
+      if (!LoadMessage(inputs[index], proto))
+        return;
+
+      std::vector<uint32_t> edges;
+      harness.Run(proto, edges);
+
+      std::vector<uint8_t> record(sizeof(CoverageRecord) + edges.size() * sizeof(uint32_t));
+      const CoverageRecord header{index, static_cast<uint32_t>(edges.size())};
+      memcpy(record.data(), &header, sizeof(header));
+      memcpy(record.data() + sizeof(header), edges.data(), edges.size() * sizeof(uint32_t));
+
+      if (write(fileno(records[worker]), record.data(), record.size()) < 0)
+        _exit(1);
+    });
+
+  // Collect the edge sets of all inputs
+
+  std::vector<std::vector<uint32_t>> edges(inputs.size());
+  std::vector<std::uintmax_t> sizes(inputs.size());
+
+  for (std::size_t i = 0; i < inputs.size(); i++) {
+    sizes[i] = std::filesystem::file_size(inputs[i]);
+  }
+
+  for (std::FILE *f : records) {
+    CoverageRecord header;
+    std::rewind(f);
+
+    while (std::fread(&header, sizeof(header), 1, f) == 1) {
+      if (header.index >= inputs.size())
+        break;
+
+      std::vector<uint32_t> &e = edges[header.index];
+      e.resize(header.nedges);
+      if (std::fread(e.data(), sizeof(uint32_t), header.nedges, f) != header.nedges)
+        break;
+    }
+
+    std::fclose(f);
+  }
+
+  const std::vector<std::size_t> selected = SetCover(edges, sizes, Coverage::NumEdges());
+
+  // Copy the selected inputs, converting text format to binary
+
+  for (std::size_t index : selected) {
+    const std::filesystem::path &src = inputs[index];
+
+    if (src.extension() != ".txt") {
+      std::filesystem::copy_file(src, outdir / src.filename(),
+                                 std::filesystem::copy_options::overwrite_existing);
+      continue;
+    }
+
+    T proto;
+    std::string out;
+    LoadMessage(src, proto);
+    proto.SerializeToString(&out);
+
+    std::filesystem::path dst = outdir / src.filename();
+    dst.replace_extension(".bin");
+    WriteFile(dst, reinterpret_cast<const uint8_t *>(out.data()), out.size());
+  }
+
+  for (std::size_t index : failures) {
+    std::cout << "[!] Crashed or timed out: " << inputs[index] << "\n";
+  }
+
+  std::cout << "[+] Selected " << selected.size() << " of " << inputs.size()
+            << " inputs with " << pool.size() << " workers\n";
+
+  return 0;
+}
+
+}
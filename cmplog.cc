@@ -0,0 +1,91 @@
+#include <cstring>
+
+#include "cmplog.hh"
+
+namespace lpmpp {
+
+/* -------------------------------------- */
+/* --- CmpOperands method definitions --- */
+/* -------------------------------------- */
+
+void CmpOperands::Clear() {
+  strings.clear();
+  integers.clear();
+  widths.clear();
+  string_next.clear();
+  integer_next.clear();
+  string_index.clear();
+  integer_index.clear();
+  string_sizes = 0;
+  integer_widths = 0;
+}
+
+
+void CmpOperands::AddStrings(const uint8_t *v0, std::size_t size0, const uint8_t *v1,
+  std::size_t size1) {
+
+  size0 = std::min(size0, kMaxCmpOperandSize);
+  size1 = std::min(size1, kMaxCmpOperandSize);
+
+  if (strings.size() >= kMaxCmpOperands)
+    return;
+
+  // Operands which already agree are of no use
+  if (size0 == size1 && memcmp(v0, v1, size0) == 0)
+    return;
+
+  const uint8_t *values[2] = {v0, v1};
+  const std::size_t sizes[2] = {size0, size1};
+
+  for (int side = 0; side < 2; side++) {
+    const uint32_t i = strings.size();
+    strings.emplace_back(reinterpret_cast<const char *>(values[side]), sizes[side]);
+    string_next.push_back(kEnd);
+
+    // An empty operand is only ever a replacement
+    if (sizes[side] == 0)
+      continue;
+
+    uint32_t &head = string_index.Insert(StringKey(values[side], sizes[side]), kEnd);
+    string_next[i] = head;
+    head = i;
+    string_sizes |= 1ULL << sizes[side];
+  }
+}
+
+
+void CmpOperands::AddIntegers(uint64_t v0, uint64_t v1, unsigned width) {
+  const uint64_t values[2] = {v0 & WidthMask(width), v1 & WidthMask(width)};
+
+  if (integers.size() >= kMaxCmpOperands || values[0] == values[1])
+    return;
+
+  for (int side = 0; side < 2; side++) {
+    const uint32_t i = integers.size();
+    integers.push_back(values[side]);
+    widths.push_back(width);
+
+    uint32_t &head = integer_index.Insert(IntegerKey(integers[i], width), kEnd);
+    integer_next.push_back(head);
+    head = i;
+  }
+
+  integer_widths |= 1U << width;
+}
+
+
+uint64_t CmpOperands::StringKey(const uint8_t *data, std::size_t size) {
+  uint64_t hash = HashMix(kQueueHashOffset, size);
+  for (std::size_t i = 0; i < size; i++) {
+    hash = HashMix(hash, data[i]);
+  }
+  return hash == 0 ? 1 : hash;
+}
+
+
+uint64_t CmpOperands::IntegerKey(uint64_t value, unsigned width) {
+  const uint64_t hash = HashMix(HashMix(kQueueHashOffset, width), value);
+  return hash == 0 ? 1 : hash;
+}
+
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "queue.hh"
+
+namespace lpmpp {
+
+// Operands kept from the comparisons logged for one queue entry
+static const std::size_t kMaxCmpOperands = 1024;
+// Longest routine operand logged by AFL++
+static const std::size_t kMaxCmpOperandSize = 32;
+
+
+/**
+ * @brief Operands of the comparisons logged by the cmplog binary of AFL++
+ * (`afl-fuzz -c`), indexed by value. Each operand is paired with the operand
+ * it was compared with, so that a field holding one side of a comparison
+ * can be set to the other side.
+ * 
+ * Routine operands, e.g. of strcmp or memcmp, match string and bytes fields
+ * on a prefix. Instruction operands match integer fields on their low bytes.
+ * 
+ */
+class CmpOperands {
+private:
+  static constexpr uint32_t kEnd = UINT32_MAX;
+
+  // Operands 2i and 2i + 1 were compared with each other
+  std::vector<std::string> strings;
+  std::vector<uint64_t> integers;
+  std::vector<uint8_t> widths;
+  // Next operand with the same key, chained from the index
+  std::vector<uint32_t> string_next;
+  std::vector<uint32_t> integer_next;
+  HashIndex<uint32_t> string_index;
+  HashIndex<uint32_t> integer_index;
+  // Bit n is set if an operand of n bytes was logged
+  uint64_t string_sizes = 0;
+  uint16_t integer_widths = 0;
+
+public:
+  void Clear();
+
+  /**
+   * @brief Adds the operands of a routine call, e.g. memcmp(v0, v1, n)
+   * 
+   */
+  void AddStrings(const uint8_t *v0, std::size_t size0, const uint8_t *v1, std::size_t size1);
+
+  /**
+   * @brief Adds the operands of a comparison instruction on `width` bytes
+   * 
+   */
+  void AddIntegers(uint64_t v0, uint64_t v1, unsigned width);
+
+  bool empty() const {
+    return strings.empty() && integers.empty();
+  }
+
+  std::size_t size() const {
+    return strings.size() + integers.size();
+  }
+
+  /**
+   * @brief Calls `fn(replacement, prefix)` for every operand which `value`
+   * starts with, where `prefix` is the size of the operand
+   * 
+   */
+  template<typename Fn>
+  void MatchString(const std::string &value, Fn fn) const {
+    const std::size_t max = std::min(value.size(), kMaxCmpOperandSize);
+
+    for (std::size_t n = 1; n <= max; n++) {
+      if (!(string_sizes & (1ULL << n)))
+        continue;
+
+      const uint8_t *data = reinterpret_cast<const uint8_t *>(value.data());
+      const uint32_t *head = string_index.Find(StringKey(data, n));
+
+      for (uint32_t i = head ? *head : kEnd; i != kEnd; i = string_next[i]) {
+        if (strings[i].size() == n && value.compare(0, n, strings[i]) == 0)
+          fn(strings[i ^ 1], n);
+      }
+    }
+  }
+
+  /**
+   * @brief Calls `fn(replacement, mask)` for every operand equal to the low
+   * bytes of `value`, where `mask` selects the bytes of the operand
+   * 
+   */
+  template<typename Fn>
+  void MatchInteger(uint64_t value, Fn fn) const {
+    for (unsigned width = 1; width <= 8; width *= 2) {
+      if (!(integer_widths & (1U << width)))
+        continue;
+
+      const uint64_t mask = WidthMask(width);
+      const uint32_t *head = integer_index.Find(IntegerKey(value & mask, width));
+
+      for (uint32_t i = head ? *head : kEnd; i != kEnd; i = integer_next[i]) {
+        if (widths[i] == width && integers[i] == (value & mask))
+          fn(integers[i ^ 1], mask);
+      }
+    }
+  }
+
+private:
+  static uint64_t StringKey(const uint8_t *data, std::size_t size);
+  static uint64_t IntegerKey(uint64_t value, unsigned width);
+
+  static uint64_t WidthMask(unsigned width) {
+    return width >= 8 ? UINT64_MAX : (1ULL << (8 * width)) - 1;
+  }
+};
+
+}
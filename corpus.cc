@@ -0,0 +1,155 @@
+#include <algorithm>
+#include <csignal>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "corpus.hh"
+
+namespace lpmpp {
+
+/* -------------------------------------- */
+/* --- Corpus utils --------------------- */
+/* -------------------------------------- */
+
+std::vector<std::filesystem::path> ListCorpus(const std::filesystem::path &dir) {
+  std::vector<std::filesystem::path> paths;
+
+  for (const auto &entry : std::filesystem::directory_iterator(dir)) {
+    if (entry.is_regular_file())
+      paths.push_back(entry.path());
+  }
+
+  std::sort(paths.begin(), paths.end());
+  return paths;
+}
+
+
+bool ReadFile(const std::filesystem::path &path, std::string &out) {
+  std::ifstream ifs(path, std::ios::binary);
+  if (!ifs.is_open())
+    return false;
+
+  out.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+  return !ifs.bad();
+}
+
+
+bool WriteFile(const std::filesystem::path &path, const uint8_t *buf, std::size_t size) {
+  std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+  if (!ofs.is_open())
+    return false;
+
+  ofs.write(reinterpret_cast<const char *>(buf), size);
+  return !ofs.fail();
+}
+
+/* -------------------------------------- */
+/* --- WorkerPool method definitions ---- */
+/* -------------------------------------- */
+
+static const std::size_t kNoInput = static_cast<std::size_t>(-1);
+
+
+/**
+ * @brief Runs `task` for the inputs start, start + stride ... in a forked
+ * process. Records the input being processed in `cursor` so the parent 
+ * can identify the input when the worker dies.
+ * 
+ */
+static pid_t SpawnWorker(const WorkerPool::Task &task, unsigned worker, 
+  std::size_t start, std::size_t stride, std::size_t ninputs, 
+  volatile std::size_t *cursor, unsigned timeout, bool quiet) {
+
+  pid_t pid = fork();
+  if (pid != 0)
+    return pid;
+
+  if (quiet) {
+    int fd = open("/dev/null", O_WRONLY);
+    if (fd >= 0) {
+      dup2(fd, STDOUT_FILENO);
+      dup2(fd, STDERR_FILENO);
+      close(fd);
+    }
+  }
+
+  for (std::size_t i = start; i < ninputs; i += stride) {
+    *cursor = i;
+    alarm(timeout);
+    task(i, worker);
+    alarm(0);
+  }
+
+  *cursor = kNoInput;
+  _exit(0);
+}
+
+
+std::vector<std::size_t> WorkerPool::Run(std::size_t ninputs, const Task &task) {
+  std::vector<std::size_t> failures;
+
+  // Cursors are shared with the workers so that the input being processed
+  // is known if a worker is killed
+
+  const std::size_t len = sizeof(std::size_t) * nworkers;
+  void *mem = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED)
+    throw std::runtime_error("Failed to map worker cursors");
+
+  volatile std::size_t *cursors = static_cast<volatile std::size_t *>(mem);
+  std::map<pid_t, unsigned> workers;
+
+  for (unsigned k = 0; k < nworkers && k < ninputs; k++) {
+    cursors[k] = kNoInput;
+    pid_t pid = SpawnWorker(task, k, k, nworkers, ninputs, &cursors[k], timeout, quiet);
+    if (pid < 0)
+      throw std::runtime_error("Failed to fork worker");
+    workers[pid] = k;
+  }
+
+  while (!workers.empty()) {
+    int status;
+    pid_t pid = waitpid(-1, &status, 0);
+    if (pid < 0)
+      break;
+
+    auto it = workers.find(pid);
+    if (it == workers.end())
+      continue;
+
+    const unsigned k = it->second;
+    workers.erase(it);
+
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0 && cursors[k] == kNoInput)
+      continue;
+
+    // Worker crashed or timed out, skip the input and restart the worker
+
+    const std::size_t failed = cursors[k];
+    if (failed == kNoInput)
+      continue;
+
+    failures.push_back(failed);
+
+    if (failed + nworkers < ninputs) {
+      cursors[k] = kNoInput;
+      pid_t npid = SpawnWorker(task, k, failed + nworkers, nworkers, ninputs, 
+                               &cursors[k], timeout, quiet);
+      if (npid < 0)
+        throw std::runtime_error("Failed to fork worker");
+      workers[npid] = k;
+    }
+  }
+
+  munmap(mem, len);
+  std::sort(failures.begin(), failures.end());
+  return failures;
+}
+
+}
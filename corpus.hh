@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+#include <google/protobuf/message.h>
+#include <google/protobuf/text_format.h>
+
+namespace lpmpp {
+
+/**
+ * @brief Returns the regular files in `dir`, sorted by path
+ * 
+ */
+std::vector<std::filesystem::path> ListCorpus(const std::filesystem::path &dir);
+
+/**
+ * @brief Reads the contents of `path` into `out`, returns false on failure
+ * 
+ */
+bool ReadFile(const std::filesystem::path &path, std::string &out);
+
+/**
+ * @brief Writes `size` bytes from `buf` to `path`, returns false on failure
+ * 
+ */
+bool WriteFile(const std::filesystem::path &path, const uint8_t *buf, std::size_t size);
+
+
+/**
+ * @brief Parses the corpus file `path` into `msg`. Files ending in `.txt` 
+ * are parsed as text format, all others as binary wire format.
+ * 
+ */
+inline bool LoadMessage(const std::filesystem::path &path, google::protobuf::Message &msg) {
+  std::string data;
+  if (!ReadFile(path, data))
+    return false;
+
+  if (path.extension() == ".txt")
+    return google::protobuf::TextFormat::ParseFromString(data, &msg);
+
+  return msg.ParseFromString(data);
+}
+
+
+/**
+ * @brief Runs inputs through a pool of forked workers. In-process coverage 
+ * is global to the process, so workers are processes rather than threads.
+ * Worker `k` handles the inputs k, k + nworkers, k + 2 * nworkers ... 
+ * A worker which crashes or times out is restarted after the input it was 
+ * processing.
+ * 
+ */
+class WorkerPool {
+public:
+  /**
+   * @brief Called in the worker process for each input
+   * 
+   * @param index the index of the input
+   * @param worker the index of the worker, in [0, nworkers)
+   */
+  typedef std::function<void(std::size_t index, unsigned worker)> Task;
+
+private:
+  unsigned nworkers;
+  unsigned timeout;
+  bool quiet;
+
+public:
+  /**
+   * @brief Construct a new WorkerPool
+   * 
+   * @param nworkers the number of worker processes
+   * @param timeout per input timeout in seconds, or 0 for no timeout
+   * @param quiet redirect stdout and stderr of workers to /dev/null
+   */
+  WorkerPool(unsigned nworkers, unsigned timeout, bool quiet) :
+    nworkers(nworkers == 0 ? 1 : nworkers),
+    timeout(timeout),
+    quiet(quiet) {}
+
+  unsigned size() const {
+    return nworkers;
+  }
+
+  /**
+   * @brief Runs `task` for every index in [0, ninputs) and waits for all
+   * workers to finish.
+   * 
+   * @return the indexes of inputs that crashed or timed out
+   */
+  std::vector<std::size_t> Run(std::size_t ninputs, const Task &task);
+};
+
+}
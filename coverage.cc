@@ -0,0 +1,101 @@
+#include <cstring>
+
+#include "coverage.hh"
+
+namespace lpmpp {
+
+/* -------------------------------------- */
+/* --- Counter registration ------------- */
+/* -------------------------------------- */
+
+static const std::size_t kMaxModules = 256;
+
+// Plain arrays, since modules may be registered before static constructors run
+struct CounterRegion {
+  uint8_t *start;
+  uint8_t *stop;
+};
+
+static CounterRegion regions[kMaxModules];
+static std::size_t nregions = 0;
+
+extern "C" void __sanitizer_cov_8bit_counters_init(uint8_t *start, uint8_t *stop) {
+  if (start == stop || nregions == kMaxModules)
+    return;
+
+  for (std::size_t i = 0; i < nregions; i++) {
+    if (regions[i].start == start)
+      return;
+  }
+
+  regions[nregions++] = CounterRegion{start, stop};
+}
+
+/* -------------------------------------- */
+/* --- Coverage method definitions ------ */
+/* -------------------------------------- */
+
+static const uint64_t kFNVOffset = 0xcbf29ce484222325ULL;
+static const uint64_t kFNVPrime = 0x100000001b3ULL;
+
+
+/**
+ * @brief Classify a hit count into the buckets used by AFL++
+ * 
+ */
+static uint8_t Bucket(uint8_t count) {
+  if (count <= 3) return count;
+  if (count <= 7) return 4;
+  if (count <= 15) return 5;
+  if (count <= 31) return 6;
+  if (count <= 127) return 7;
+  return 8;
+}
+
+
+std::size_t Coverage::NumEdges() {
+  std::size_t n = 0;
+  for (std::size_t i = 0; i < nregions; i++) {
+    n += regions[i].stop - regions[i].start;
+  }
+  return n;
+}
+
+
+void Coverage::Reset() {
+  for (std::size_t i = 0; i < nregions; i++) {
+    memset(regions[i].start, 0, regions[i].stop - regions[i].start);
+  }
+}
+
+
+uint64_t Coverage::Signature() {
+  uint64_t hash = kFNVOffset;
+  uint32_t index = 0;
+
+  for (std::size_t i = 0; i < nregions; i++) {
+    for (const uint8_t *p = regions[i].start; p < regions[i].stop; p++, index++) {
+      if (*p == 0)
+        continue;
+
+      hash = (hash ^ index) * kFNVPrime;
+      hash = (hash ^ Bucket(*p)) * kFNVPrime;
+    }
+  }
+
+  return hash;
+}
+
+
+void Coverage::CollectEdges(std::vector<uint32_t> &edges) {
+  uint32_t index = 0;
+
+  for (std::size_t i = 0; i < nregions; i++) {
+    for (const uint8_t *p = regions[i].start; p < regions[i].stop; p++, index++) {
+      if (*p != 0)
+        edges.push_back(index);
+    }
+  }
+}
+
+}
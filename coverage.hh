@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace lpmpp {
+
+/**
+ * @brief Edge coverage collected in-process from SanitizerCoverage inline 
+ * 8-bit counters. The target must be compiled with 
+ * `-fsanitize-coverage=inline-8bit-counters`, the counters are registered
+ * through `__sanitizer_cov_8bit_counters_init` before main runs.
+ * 
+ */
+class Coverage {
+public:
+  /**
+   * @brief returns the total number of edges in all registered modules
+   * 
+   */
+  static std::size_t NumEdges();
+
+  /**
+   * @brief Zero all counters, called before every execution
+   * 
+   */
+  static void Reset();
+
+  /**
+   * @brief returns a hash of the edges hit by the last execution, with hit
+   * counts classified into the same buckets as AFL++
+   * 
+   */
+  static uint64_t Signature();
+
+  /**
+   * @brief Appends the index of every edge hit by the last execution to
+   * `edges`, in increasing order
+   * 
+   */
+  static void CollectEdges(std::vector<uint32_t> &edges);
+};
+
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace lpmpp {
+
+// Blocks of a generation of the mutant filter, one cache line each
+static const std::size_t kDedupBlocks = 256;
+// Bits set per mutant within its block
+static const int kDedupProbes = 6;
+// Mutants per generation, the older generation is forgotten after that
+static const uint32_t kDedupGeneration = 8192;
+// Mutations retried when the mutant is a duplicate, the last one is kept
+static const int kDedupRetries = 4;
+
+static const uint64_t kBytesHashSeed = 0x9e3779b97f4a7c15ULL;
+static const uint64_t kBytesHashPrime = 0xff51afd7ed558ccdULL;
+
+
+/**
+ * @brief Fast non-cryptographic 64-bit hash of `size` bytes, eight at a time
+ * 
+ */
+inline uint64_t HashBytes(const uint8_t *data, std::size_t size) {
+  uint64_t hash = kBytesHashSeed ^ (size * kBytesHashPrime);
+  std::size_t i = 0;
+
+  for (; i + 8 <= size; i += 8) {
+    uint64_t word;
+    memcpy(&word, data + i, 8);
+    hash = (hash ^ word) * kBytesHashPrime;
+    hash ^= hash >> 29;
+  }
+
+  uint64_t tail = 0;
+  if (i < size)
+    memcpy(&tail, data + i, size - i);
+  hash = (hash ^ tail) * kBytesHashPrime;
+
+  // Final avalanche, as the murmur3 finalizer
+  hash ^= hash >> 33;
+  hash *= kBytesHashPrime;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+
+/**
+ * @brief Blocked Bloom filter over the hashes of recent mutants. A hash
+ * selects one cache-line block and sets kDedupProbes bits in it, so a
+ * lookup touches a single line. Two generations of kDedupBlocks blocks
+ * (32 KiB) are kept: inserts go to the current one, which replaces the
+ * older one once it holds kDedupGeneration mutants. Each instance is used
+ * by a single thread and needs no locks.
+ * 
+ */
+class MutantFilter {
+private:
+  struct alignas(64) Block {
+    uint64_t words[8];
+  };
+
+  Block generations[2][kDedupBlocks] = {};
+  int current = 0;
+  uint32_t inserted = 0;
+
+public:
+  /**
+   * @brief Adds `hash`, returns false if it was already present, possibly
+   * a false positive
+   * 
+   */
+  bool Insert(uint64_t hash) {
+    if (Contains(generations[current], hash))
+      return false;
+
+    const bool seen = Contains(generations[current ^ 1], hash);
+    Set(generations[current], hash);
+
+    if (++inserted == kDedupGeneration) {
+      current ^= 1;
+      memset(generations[current], 0, sizeof(generations[current]));
+      inserted = 0;
+    }
+
+    return !seen;
+  }
+
+private:
+  // The top byte selects the block, the low 54 bits the probed bits
+  static std::size_t BlockOf(uint64_t hash) {
+    return (hash >> 56) % kDedupBlocks;
+  }
+
+  static bool Contains(const Block *blocks, uint64_t hash) {
+    const Block &block = blocks[BlockOf(hash)];
+    for (int i = 0; i < kDedupProbes; i++) {
+      const unsigned bit = (hash >> (9 * i)) & 511;
+      if (!(block.words[bit >> 6] & (1ULL << (bit & 63))))
+        return false;
+    }
+    return true;
+  }
+
+  static void Set(Block *blocks, uint64_t hash) {
+    Block &block = blocks[BlockOf(hash)];
+    for (int i = 0; i < kDedupProbes; i++) {
+      const unsigned bit = (hash >> (9 * i)) & 511;
+      block.words[bit >> 6] |= 1ULL << (bit & 63);
+    }
+  }
+};
+
+}
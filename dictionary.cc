@@ -0,0 +1,221 @@
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+
+#include "dictionary.hh"
+
+using namespace google::protobuf;
+
+namespace lpmpp {
+
+/* -------------------------------------- */
+/* --- TokenTrie method definitions ----- */
+/* -------------------------------------- */
+
+int32_t TokenTrie::Insert(const uint8_t *data, std::size_t size) {
+  if (size == 0 || size > kMaxTokenSize)
+    return -1;
+
+  uint32_t node = 0;
+  for (std::size_t i = 0; i < size; i++) {
+    const uint64_t key = EdgeKey(node, data[i]);
+    if (const uint32_t *child = edges.Find(key)) {
+      node = *child;
+      continue;
+    }
+
+    if (tokens.size() >= kMaxTokens)
+      return -1;
+
+    const uint32_t child = terminal.size();
+    terminal.push_back(-1);
+    edges.Insert(key, child);
+    node = child;
+  }
+
+  if (terminal[node] < 0) {
+    if (tokens.size() >= kMaxTokens)
+      return -1;
+
+    terminal[node] = tokens.size();
+    tokens.emplace_back(reinterpret_cast<const char *>(data), size);
+  }
+
+  return terminal[node];
+}
+
+int32_t TokenTrie::Find(const uint8_t *data, std::size_t size) const {
+  if (size == 0 || size > kMaxTokenSize)
+    return -1;
+
+  uint32_t node = 0;
+  for (std::size_t i = 0; i < size; i++) {
+    const uint32_t *child = edges.Find(EdgeKey(node, data[i]));
+    if (!child)
+      return -1;
+    node = *child;
+  }
+
+  return terminal[node];
+}
+
+/* -------------------------------------- */
+/* --- Dictionary method definitions ---- */
+/* -------------------------------------- */
+
+/**
+ * @brief Parses a line of an AFL++ dictionary, `name@level="value"` where
+ * the name and level are optional, into `token`. Returns false if the line
+ * is malformed.
+ * 
+ */
+static bool ParseTokenLine(const std::string &line, std::string &token) {
+  std::size_t i = line.find('"');
+  if (i == std::string::npos)
+    return false;
+
+  token.clear();
+
+  for (i++; i < line.size(); i++) {
+    const char c = line[i];
+
+    if (c == '"') {
+      // Only whitespace may follow the value
+      for (i++; i < line.size(); i++) {
+        if (!isspace(static_cast<unsigned char>(line[i])))
+          return false;
+      }
+      return true;
+    }
+
+    if (c != '\\') {
+      token.push_back(c);
+      continue;
+    }
+
+    if (++i == line.size())
+      return false;
+
+    if (line[i] == '\\' || line[i] == '"') {
+      token.push_back(line[i]);
+    } else if (line[i] == 'x' && i + 2 < line.size() &&
+               isxdigit(static_cast<unsigned char>(line[i + 1])) &&
+               isxdigit(static_cast<unsigned char>(line[i + 2]))) {
+      token.push_back(static_cast<char>(std::stoi(line.substr(i + 1, 2), nullptr, 16)));
+      i += 2;
+    } else {
+      return false;
+    }
+  }
+
+  return false;
+}
+
+
+void Dictionary::Add(const uint8_t *data, std::size_t size) {
+  const int32_t token = trie.Insert(data, size);
+  if (token < 0)
+    return;
+
+  if (listed.size() <= static_cast<std::size_t>(token))
+    listed.resize(token + 1);
+
+  if (!listed[token]) {
+    listed[token] = true;
+    dictionary.push_back(token);
+  }
+}
+
+
+bool Dictionary::Load(const char *path, std::string &error) {
+  std::ifstream file(path);
+  if (!file) {
+    error = std::string("cannot read dictionary ") + path;
+    return false;
+  }
+
+  std::string line;
+  std::string token;
+  int number = 0;
+
+  while (std::getline(file, line)) {
+    number++;
+
+    const std::size_t start = line.find_first_not_of(" \t\r");
+    if (start == std::string::npos || line[start] == '#')
+      continue;
+
+    if (!ParseTokenLine(line, token)) {
+      error = std::string("malformed token in ") + path + " line " + std::to_string(number);
+      return false;
+    }
+
+    Add(reinterpret_cast<const uint8_t *>(token.data()), token.size());
+  }
+
+  return true;
+}
+
+
+void Dictionary::Learn(const FieldTable &table, const FieldEntry &entry, const std::string &value) {
+  if (fields.size() <= static_cast<std::size_t>(table.id))
+    fields.resize(table.id + 1);
+
+  std::vector<FieldTokens> &pools = fields[table.id];
+  if (pools.empty())
+    pools.resize(table.fields.size());
+
+  FieldTokens &pool = pools[entry.index];
+  const uint8_t *data = reinterpret_cast<const uint8_t *>(value.data());
+
+  trie.Match(data, std::min(value.size(), kMaxTokenScan), [&](uint32_t token) {
+    Record(pool, token);
+  });
+
+  if (value.size() < kMinLearnedToken)
+    return;
+
+  int32_t token = trie.Find(data, value.size());
+  if (token < 0) {
+    if (learned >= kMaxLearnedTokens)
+      return;
+
+    token = trie.Insert(data, value.size());
+    if (token < 0)
+      return;
+
+    learned++;
+  }
+
+  Record(pool, token);
+}
+
+
+const std::string * Dictionary::Choose(const FieldDescriptor &field, uint64_t random) const {
+  const std::size_t id = GetFieldTable(*field.containing_type()).id;
+  const FieldTokens *pool = id < fields.size() && !fields[id].empty()
+                          ? &fields[id][field.index()] : nullptr;
+  const uint32_t learned = pool ? std::min<uint32_t>(pool->seen, kFieldTokens) : 0;
+
+  // Half of the choices go to the tokens of the field when it has any
+  if (learned > 0 && (dictionary.empty() || random & 1))
+    return &trie.token(pool->tokens[(random >> 1) % learned]);
+
+  if (!dictionary.empty())
+    return &trie.token(dictionary[(random >> 1) % dictionary.size()]);
+
+  return nullptr;
+}
+
+
+void Dictionary::Record(FieldTokens &pool, uint32_t token) {
+  const uint32_t n = std::min<uint32_t>(pool.seen, kFieldTokens);
+  for (uint32_t i = 0; i < n; i++) {
+    if (pool.tokens[i] == token)
+      return;
+  }
+
+  pool.tokens[pool.seen++ % kFieldTokens] = token;
+}
+
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <google/protobuf/descriptor.h>
+
+#include "fieldtable.hh"
+#include "queue.hh"
+
+namespace lpmpp {
+
+// Dictionary in the AFL++ format, e.g. written by AFL_LLVM_DICT2FILE
+static const char * const kTokenFileEnv = "AFL_TOKEN_FILE";
+// Longest token kept, as AFL++ MAX_DICT_FILE
+static const std::size_t kMaxTokenSize = 128;
+// Tokens kept across dictionaries and learned values
+static const std::size_t kMaxTokens = 1 << 14;
+// Tokens kept from learned values, the rest is reserved for dictionaries
+static const std::size_t kMaxLearnedTokens = kMaxTokens / 2;
+// Bytes of a value searched for tokens when learning
+static const std::size_t kMaxTokenScan = 4096;
+// Shortest value learned as a token, as AFL++ MIN_AUTO_EXTRA
+static const std::size_t kMinLearnedToken = 3;
+// Most recent tokens kept per field
+static const int kFieldTokens = 16;
+// Share of string mutations which use a token, once there are any
+static const double kTokenShare = 0.5;
+
+
+/**
+ * @brief Byte trie of unique tokens. Edges are kept in a single hash index
+ * keyed by node and byte, so that a node costs one entry per child.
+ * 
+ */
+class TokenTrie {
+private:
+  // Token ending at each node, or -1
+  std::vector<int32_t> terminal = {-1};
+  HashIndex<uint32_t> edges;
+  std::vector<std::string> tokens;
+
+public:
+  /**
+   * @brief Adds a token, returns its number or -1 if it is empty, too long
+   * or the trie is full. Adding a token twice returns the same number.
+   * 
+   */
+  int32_t Insert(const uint8_t *data, std::size_t size);
+
+  /**
+   * @brief returns the number of a token, or -1 if it was not added
+   * 
+   */
+  int32_t Find(const uint8_t *data, std::size_t size) const;
+
+  /**
+   * @brief Calls `fn(token)` for every occurrence of a token in `data`
+   * 
+   */
+  template<typename Fn>
+  void Match(const uint8_t *data, std::size_t size, Fn fn) const {
+    for (std::size_t start = 0; start < size; start++) {
+      uint32_t node = 0;
+
+      for (std::size_t i = start; i < size && i - start < kMaxTokenSize; i++) {
+        const uint32_t *child = edges.Find(EdgeKey(node, data[i]));
+        if (!child)
+          break;
+
+        node = *child;
+        if (terminal[node] >= 0)
+          fn(static_cast<uint32_t>(terminal[node]));
+      }
+    }
+  }
+
+  const std::string & token(uint32_t id) const {
+    return tokens[id];
+  }
+
+  std::size_t size() const {
+    return tokens.size();
+  }
+
+private:
+  static uint64_t EdgeKey(uint32_t node, uint8_t byte) {
+    return (static_cast<uint64_t>(node) + 1) << 8 | byte;
+  }
+};
+
+
+/**
+ * @brief Tokens for string and bytes mutations: the dictionaries of AFL++,
+ * and per field the dictionary tokens and short values found in that field
+ * in new queue entries.
+ * 
+ */
+class Dictionary {
+private:
+  struct FieldTokens {
+    uint32_t seen = 0;
+    uint32_t tokens[kFieldTokens];
+  };
+
+  TokenTrie trie;
+  // Tokens added from dictionaries, as opposed to learned ones
+  std::vector<uint32_t> dictionary;
+  std::vector<bool> listed;
+  // Tokens added from learned values only
+  std::size_t learned = 0;
+  // Indexed by FieldTable::id, then FieldDescriptor::index()
+  std::vector<std::vector<FieldTokens>> fields;
+
+public:
+  /**
+   * @brief Adds a dictionary token
+   * 
+   */
+  void Add(const uint8_t *data, std::size_t size);
+
+  /**
+   * @brief Adds the tokens of the AFL++ dictionary file in `path`, returns
+   * false and sets `error` if it cannot be read or parsed
+   * 
+   */
+  bool Load(const char *path, std::string &error);
+
+  /**
+   * @brief Records the tokens in `value`, a value of `entry` in a new queue
+   * entry, and the value itself if it is short enough to be a token. At
+   * most kMaxLearnedTokens values are added, so that dictionary tokens 
+   * found later still fit.
+   * 
+   */
+  void Learn(const FieldTable &table, const FieldEntry &entry, const std::string &value);
+
+  /**
+   * @brief Chooses a token for `field`, from the tokens learned for it or
+   * from the dictionaries. Returns nullptr if there are none.
+   * 
+   * @param random a random number to choose with
+   */
+  const std::string * Choose(const google::protobuf::FieldDescriptor &field, uint64_t random) const;
+
+  bool empty() const {
+    return trie.size() == 0;
+  }
+
+  std::size_t size() const {
+    return trie.size();
+  }
+
+private:
+  void Record(FieldTokens &pool, uint32_t token);
+};
+
+}
@@ -0,0 +1,293 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unistd.h>
+
+#include "fieldtable.hh"
+#include "trimming.hh"
+#include "utils.hh"
+
+using namespace google::protobuf;
+
+namespace lpmpp {
+
+/* -------------------------------------- */
+/* --- Field tables --------------------- */
+/* -------------------------------------- */
+
+static std::unordered_map<const Descriptor *, std::unique_ptr<FieldTable>> tables;
+
+// Walks usually visit many messages of the same type in a row
+static const Descriptor *last = nullptr;
+static const FieldTable *last_table = nullptr;
+
+
+/**
+ * @brief Sorts the entries of `table` by field number and indexes them
+ * 
+ */
+static void IndexFieldTable(FieldTable &table) {
+  std::sort(table.fields.begin(), table.fields.end(), [](const FieldEntry &a, const FieldEntry &b) {
+    return a.field->number() < b.field->number();
+  });
+
+  table.positions.resize(table.desc->field_count());
+  for (std::size_t i = 0; i < table.fields.size(); i++) {
+    table.positions[table.fields[i].index] = i;
+  }
+}
+
+
+static std::unique_ptr<FieldTable> BuildFieldTable(const Descriptor &desc, int id) {
+  auto table = std::make_unique<FieldTable>();
+  table->desc = &desc;
+  table->id = id;
+  table->has_messages = false;
+
+  for (int i = 0; i < desc.field_count(); i++) {
+    const FieldDescriptor &field = *desc.field(i);
+
+    FieldEntry entry;
+    entry.field = &field;
+    entry.cpp_type = field.cpp_type();
+    entry.type = field.type();
+    entry.index = field.index();
+    entry.repeated = field.is_repeated();
+    entry.message = entry.cpp_type == FieldDescriptor::CppType::CPPTYPE_MESSAGE;
+    entry.required = field.is_required();
+    entry.presence = field.has_presence();
+    entry.oneof = field.containing_oneof() != nullptr;
+    entry.deletable = !entry.required && entry.presence;
+
+    entry.trim_mask = 0;
+    if (NodeTrimTask::CanHandle(field))
+      entry.trim_mask |= 1u << TrimType::NODES;
+    if (StringTrimTask::CanHandle(field))
+      entry.trim_mask |= 1u << TrimType::STRINGS;
+    if (ChunkTrimTask::CanHandle(field))
+      entry.trim_mask |= 1u << TrimType::CHUNKS;
+
+    table->has_messages |= entry.message;
+    table->fields.push_back(entry);
+  }
+
+  IndexFieldTable(*table);
+  return table;
+}
+
+
+const FieldTable & GetFieldTable(const Descriptor &desc) {
+  if (&desc == last)
+    return *last_table;
+
+  auto it = tables.find(&desc);
+  if (it == tables.end())
+    it = tables.emplace(&desc, BuildFieldTable(desc, tables.size())).first;
+
+  last = &desc;
+  last_table = it->second.get();
+  return *last_table;
+}
+
+
+int NumFieldTables() {
+  return tables.size();
+}
+
+
+
+void BuildFieldTables(const Descriptor &desc) {
+  std::vector<const Descriptor *> stack = {&desc};
+
+  while (!stack.empty()) {
+    const Descriptor *next = stack.back();
+    stack.pop_back();
+
+    if (tables.contains(next))
+      continue;
+
+    for (const FieldEntry &entry : GetFieldTable(*next).fields) {
+      if (entry.message)
+        stack.push_back(entry.field->message_type());
+    }
+  }
+}
+
+
+void ResetFieldTables() {
+  tables.clear();
+  last = nullptr;
+  last_table = nullptr;
+}
+
+/* -------------------------------------- */
+/* --- Plan cache ----------------------- */
+/* -------------------------------------- */
+
+/* The plan cache is a flat file: a header, then for every table its type
+name and one fixed size record per field. Descriptors are resolved by name
+on load, the flags are taken as they are. */
+
+struct PlanHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t ntables;
+  uint32_t reserved;
+  uint64_t schema;
+};
+
+struct PlanTable {
+  uint32_t name_size;
+  uint32_t nfields;
+};
+
+struct PlanField {
+  int32_t index;
+  uint8_t cpp_type;
+  uint8_t type;
+  uint8_t flags;
+  uint8_t trim_mask;
+};
+
+enum PlanFlags : uint8_t {
+  PLAN_REPEATED  = 1 << 0,
+  PLAN_MESSAGE   = 1 << 1,
+  PLAN_REQUIRED  = 1 << 2,
+  PLAN_PRESENCE  = 1 << 3,
+  PLAN_ONEOF     = 1 << 4,
+  PLAN_DELETABLE = 1 << 5,
+};
+
+
+bool SaveFieldTables(const char *path, uint64_t schema) {
+  std::vector<const FieldTable *> sorted;
+  for (const auto &[desc, table] : tables)
+    sorted.push_back(table.get());
+
+  // Keep the ids of the tables across runs
+  std::sort(sorted.begin(), sorted.end(), [](const FieldTable *a, const FieldTable *b) {
+    return a->id < b->id;
+  });
+
+  std::string out;
+  const PlanHeader header = {kPlanCacheMagic, kPlanCacheVersion, 
+                             static_cast<uint32_t>(sorted.size()), 0, schema};
+  out.append(reinterpret_cast<const char *>(&header), sizeof(header));
+
+  for (const FieldTable *table : sorted) {
+    const std::string &name = table->desc->full_name();
+    const PlanTable record = {static_cast<uint32_t>(name.size()), 
+                              static_cast<uint32_t>(table->fields.size())};
+    out.append(reinterpret_cast<const char *>(&record), sizeof(record));
+    out.append(name);
+
+    for (const FieldEntry &entry : table->fields) {
+      PlanField field = {entry.index, static_cast<uint8_t>(entry.cpp_type), 
+                         static_cast<uint8_t>(entry.type), 0, entry.trim_mask};
+      field.flags = (entry.repeated ? PLAN_REPEATED : 0) | (entry.message ? PLAN_MESSAGE : 0) |
+                    (entry.required ? PLAN_REQUIRED : 0) | (entry.presence ? PLAN_PRESENCE : 0) |
+                    (entry.oneof ? PLAN_ONEOF : 0) | (entry.deletable ? PLAN_DELETABLE : 0);
+      out.append(reinterpret_cast<const char *>(&field), sizeof(field));
+    }
+  }
+
+  const std::string tmp = std::string(path) + ".tmp." + std::to_string(getpid());
+  FILE *file = std::fopen(tmp.c_str(), "wb");
+  if (!file)
+    return false;
+
+  const bool written = std::fwrite(out.data(), 1, out.size(), file) == out.size();
+  if (std::fclose(file) != 0 || !written || std::rename(tmp.c_str(), path) != 0) {
+    std::remove(tmp.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+
+bool LoadFieldTables(const char *path, uint64_t schema, const DescriptorPool &pool) {
+  MappedFile file;
+  if (!file.Open(path))
+    return false;
+
+  const uint8_t *p = file.data();
+  const uint8_t *end = p + file.size();
+
+  auto read = [&](void *dst, std::size_t size) {
+    if (static_cast<std::size_t>(end - p) < size)
+      return false;
+    memcpy(dst, p, size);
+    p += size;
+    return true;
+  };
+
+  PlanHeader header;
+  if (!read(&header, sizeof(header)) || header.magic != kPlanCacheMagic || 
+      header.version != kPlanCacheVersion || header.schema != schema)
+    return false;
+
+  // Nothing is registered until the whole file has been validated
+  std::vector<std::unique_ptr<FieldTable>> loaded;
+
+  for (uint32_t i = 0; i < header.ntables; i++) {
+    PlanTable record;
+    if (!read(&record, sizeof(record)) || static_cast<std::size_t>(end - p) < record.name_size)
+      return false;
+
+    const std::string name(reinterpret_cast<const char *>(p), record.name_size);
+    p += record.name_size;
+
+    const Descriptor *desc = pool.FindMessageTypeByName(name);
+    if (!desc || static_cast<int>(record.nfields) != desc->field_count())
+      return false;
+
+    auto table = std::make_unique<FieldTable>();
+    table->desc = desc;
+    table->has_messages = false;
+
+    for (uint32_t j = 0; j < record.nfields; j++) {
+      PlanField field;
+      if (!read(&field, sizeof(field)) || field.index < 0 || field.index >= desc->field_count())
+        return false;
+
+      FieldEntry entry;
+      entry.field = desc->field(field.index);
+      if (static_cast<uint8_t>(entry.field->cpp_type()) != field.cpp_type ||
+          static_cast<uint8_t>(entry.field->type()) != field.type)
+        return false;
+
+      entry.cpp_type = static_cast<FieldDescriptor::CppType>(field.cpp_type);
+      entry.type = static_cast<FieldDescriptor::Type>(field.type);
+      entry.index = field.index;
+      entry.repeated = field.flags & PLAN_REPEATED;
+      entry.message = field.flags & PLAN_MESSAGE;
+      entry.required = field.flags & PLAN_REQUIRED;
+      entry.presence = field.flags & PLAN_PRESENCE;
+      entry.oneof = field.flags & PLAN_ONEOF;
+      entry.deletable = field.flags & PLAN_DELETABLE;
+      entry.trim_mask = field.trim_mask;
+
+      table->has_messages |= entry.message;
+      table->fields.push_back(entry);
+    }
+
+    IndexFieldTable(*table);
+    loaded.push_back(std::move(table));
+  }
+
+  for (auto &table : loaded) {
+    if (tables.contains(table->desc))
+      continue;
+
+    table->id = tables.size();
+    tables.emplace(table->desc, std::move(table));
+  }
+
+  return true;
+}
+
+}
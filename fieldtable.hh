@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/message.h>
+
+namespace lpmpp {
+
+/**
+ * @brief Flattened properties of a field, so that tree walks do not query
+ * the descriptor for every visit
+ * 
+ */
+struct FieldEntry {
+  const google::protobuf::FieldDescriptor *field;
+  google::protobuf::FieldDescriptor::CppType cpp_type;
+  google::protobuf::FieldDescriptor::Type type;
+  int index;
+  bool repeated;
+  bool message;
+  bool required;
+  bool presence;
+  bool oneof;
+  // Whether the field can be removed without making the message invalid
+  bool deletable;
+  // Bit per TrimType for which the field can be trimmed
+  uint8_t trim_mask;
+
+  bool trimmable(int trim_type) const {
+    return trim_mask & (1u << trim_type);
+  }
+};
+
+
+/**
+ * @brief Fields of a message type, ordered by field number like 
+ * Reflection::ListFields. Every type gets a dense id, which can be used to
+ * index per-type state.
+ * 
+ */
+struct FieldTable {
+  const google::protobuf::Descriptor *desc;
+  int id;
+  bool has_messages;
+  std::vector<FieldEntry> fields;
+  // Position in `fields` of each field, by FieldDescriptor::index()
+  std::vector<int> positions;
+
+  /**
+   * @brief returns the entry for `field`, which must belong to this type
+   * 
+   */
+  const FieldEntry & entry(const google::protobuf::FieldDescriptor &field) const {
+    return fields[positions[field.index()]];
+  }
+};
+
+
+/**
+ * @brief returns the field table for `desc`, built on first use. Tables live
+ * for the lifetime of the process. Not thread-safe, like the rest of the 
+ * mutator.
+ * 
+ */
+const FieldTable & GetFieldTable(const google::protobuf::Descriptor &desc);
+
+inline const FieldTable & GetFieldTable(const google::protobuf::Message &msg) {
+  return GetFieldTable(*msg.GetDescriptor());
+}
+
+/**
+ * @brief returns the number of field tables built so far
+ * 
+ */
+int NumFieldTables();
+
+/**
+ * @brief builds the tables of `desc` and of every message type reachable
+ * from it
+ * 
+ */
+void BuildFieldTables(const google::protobuf::Descriptor &desc);
+
+/**
+ * @brief drops every table, the descriptors of a pool that is about to be
+ * destroyed must not outlive it in the cache
+ * 
+ */
+void ResetFieldTables();
+
+
+/* -------------------------------------- */
+/* --- Plan cache ----------------------- */
+/* -------------------------------------- */
+
+static const uint32_t kPlanCacheMagic = 0x6e6c706c; // "lpln"
+static const uint32_t kPlanCacheVersion = 1;
+
+/**
+ * @brief writes every table built so far to `path`, tagged with `schema`,
+ * a hash of the descriptors they were built from. The file is replaced 
+ * atomically, so concurrent instances may share it.
+ * 
+ */
+bool SaveFieldTables(const char *path, uint64_t schema);
+
+/**
+ * @brief maps the tables written by SaveFieldTables and registers them for
+ * the message types of `pool`. Returns false, registering nothing, if the
+ * file is missing, corrupt or was written for another schema.
+ * 
+ */
+bool LoadFieldTables(const char *path, uint64_t schema, 
+                     const google::protobuf::DescriptorPool &pool);
+
+
+/**
+ * @brief returns true if `entry` is set in `msg`, i.e. if it would be listed
+ * by Reflection::ListFields
+ * 
+ */
+inline bool IsSet(const google::protobuf::Message &msg, const google::protobuf::Reflection &reflection, 
+                  const FieldEntry &entry) {
+  return entry.repeated ? reflection.FieldSize(msg, entry.field) > 0 
+                        : reflection.HasField(msg, entry.field);
+}
+
+}
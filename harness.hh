@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include <google/protobuf/message.h>
+
+#include "coverage.hh"
+#include "utils.hh"
+
+extern "C" {
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, std::size_t size);
+__attribute__((weak)) int LLVMFuzzerInitialize(int *argc, char ***argv);
+
+}
+
+namespace lpmpp {
+
+/**
+ * @brief Runs messages through a linked libFuzzer-style harness and 
+ * reports the coverage of each execution. Messages are converted with the 
+ * same encoder as the campaign's post_process, or passed to the harness in
+ * binary format if no encoder is given.
+ * 
+ */
+template<Derived<google::protobuf::Message> T>
+class Harness {
+public:
+  typedef std::function<std::string(const T &)> Encoder;
+
+private:
+  Encoder encoder;
+  std::string buf;
+
+public:
+  Harness(Encoder encoder) : encoder(std::move(encoder)) {}
+
+  /**
+   * @brief Calls LLVMFuzzerInitialize if the harness defines it
+   * 
+   */
+  void Init(int *argc, char ***argv) {
+    if (LLVMFuzzerInitialize)
+      LLVMFuzzerInitialize(argc, argv);
+  }
+
+  /**
+   * @brief Executes `proto` and returns the coverage signature
+   * 
+   */
+  uint64_t Run(const T &proto) {
+    Execute(proto);
+    return Coverage::Signature();
+  }
+
+  /**
+   * @brief Executes `proto` and writes the edges hit to `edges`
+   * 
+   */
+  void Run(const T &proto, std::vector<uint32_t> &edges) {
+    Execute(proto);
+    edges.clear();
+    Coverage::CollectEdges(edges);
+  }
+
+private:
+  void Execute(const T &proto) {
+    if (encoder) {
+      buf = encoder(proto);
+    } else {
+      buf.clear();
+      proto.SerializeToString(&buf);
+    }
+
+    Coverage::Reset();
+    LLVMFuzzerTestOneInput(reinterpret_cast<const uint8_t *>(buf.data()), buf.size());
+  }
+};
+
+}
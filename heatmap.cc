@@ -0,0 +1,53 @@
+#include <algorithm>
+#include <cmath>
+
+#include "heatmap.hh"
+
+namespace lpmpp {
+
+/* -------------------------------------- */
+/* --- FieldHeatmap method definitions -- */
+/* -------------------------------------- */
+
+void FieldHeatmap::Update() {
+  double chosen = 0;
+  double yields = 0;
+  double seen = 0;
+  std::size_t nfields = 0;
+
+  for (Entry &e : types) {
+    for (std::size_t i = 0; i < e.arms.size(); i++) {
+      chosen += e.arms[i].chosen;
+      yields += e.arms[i].yields;
+      seen += e.seen[i];
+    }
+    nfields += e.arms.size();
+  }
+
+  // Weigh the heat of a field by how often it was mutated, otherwise hot 
+  // fields get hotter only because they are chosen more often
+
+  const double mean = chosen > 0 ? yields / chosen : 0;
+  const double mean_seen = nfields > 0 ? seen / nfields : 0;
+
+  for (Entry &e : types) {
+    for (std::size_t i = 0; i < e.arms.size(); i++) {
+      Arm &arm = e.arms[i];
+      double weight = 1.0;
+
+      if (mean > 0) {
+        const double rate = (arm.yields + kSchedulerPrior * mean) / (arm.chosen + kSchedulerPrior);
+        weight = rate / mean;
+      }
+
+      // Fields found in few queue entries have been explored less
+      const double rarity = std::sqrt((mean_seen + 1) / (e.seen[i] + 1));
+      weight *= std::clamp(rarity, kHeatmapMinRarity, kHeatmapMaxRarity);
+      e.weights[i] = std::clamp(weight, kHeatmapMinWeight, kHeatmapMaxWeight);
+
+      arm.Decay(kHeatmapDecay);
+    }
+  }
+}
+
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <google/protobuf/descriptor.h>
+
+#include "fieldtable.hh"
+#include "operators.hh"
+#include "scheduler.hh"
+
+namespace lpmpp {
+
+// Selections between recomputing the field weights
+static const uint64_t kHeatmapEpoch = 4096;
+// Heat kept from the previous epoch
+static const double kHeatmapDecay = 0.5;
+// Share of the heat credited to each enclosing field of a mutated field
+static const double kHeatmapPathShare = 0.25;
+// Bounds of the relative weight of a field
+static const double kHeatmapMinWeight = 0.05;
+static const double kHeatmapMaxWeight = 16.0;
+// Bounds of the factor favouring fields that are rare in the queue
+static const double kHeatmapMinRarity = 0.5;
+static const double kHeatmapMaxRarity = 2.0;
+
+
+/**
+ * @brief Decaying heat score per descriptor field, built from the fields
+ * mutated in the parents of new queue entries. Field weights are 
+ * precomputed into a flat array per message type once per epoch, so that
+ * weighting a candidate field is an array lookup.
+ * 
+ */
+class FieldHeatmap {
+private:
+  struct Entry {
+    std::vector<Arm> arms;
+    std::vector<double> weights;
+    // Queue entries containing each field, and the last entry recorded so
+    // that repeated fields count once per entry
+    std::vector<uint32_t> seen;
+    std::vector<uint32_t> stamps;
+  };
+
+  // Indexed by FieldTable::id
+  std::vector<Entry> types;
+  uint64_t nselections = 0;
+
+public:
+  /**
+   * @brief returns the weights of the fields of `table`, indexed by 
+   * FieldDescriptor::index(). A field with an average yield rate has weight
+   * 1.0. The array is valid until the next call to Update.
+   * 
+   */
+  const double * Weights(const FieldTable &table) {
+    return entry(table).weights.data();
+  }
+
+  /**
+   * @brief Records that the field of `tag`, and the fields enclosing it, 
+   * were mutated
+   * 
+   */
+  void Chosen(const MutationTag &tag) {
+    Credit(tag, &Arm::chosen);
+
+    if (++nselections % kHeatmapEpoch == 0)
+      Update();
+  }
+
+  /**
+   * @brief Heats the field of `tag`, and the fields enclosing it
+   * 
+   */
+  void Reward(const MutationTag &tag) {
+    Credit(tag, &Arm::yields);
+  }
+
+  /**
+   * @brief Records that the new queue entry numbered `id` contains `entry`,
+   * fields which are rare in the queue are weighted up
+   * 
+   */
+  void Present(uint32_t id, const FieldTable &table, const FieldEntry &entry) {
+    Entry &e = this->entry(table);
+    if (e.stamps[entry.index] != id) {
+      e.stamps[entry.index] = id;
+      e.seen[entry.index]++;
+    }
+  }
+
+  /**
+   * @brief returns the number of queue entries which contained `field`
+   * 
+   */
+  uint32_t Seen(const google::protobuf::FieldDescriptor &field) {
+    return entry(GetFieldTable(*field.containing_type())).seen[field.index()];
+  }
+
+  /**
+   * @brief returns the decayed number of queue entries credited to `field`
+   * 
+   */
+  double Heat(const google::protobuf::FieldDescriptor *field) {
+    return arm(field).yields;
+  }
+
+  /**
+   * @brief Recomputes the field weights and decays the heat
+   * 
+   */
+  void Update();
+
+private:
+  Entry & entry(const FieldTable &table) {
+    if (types.size() <= static_cast<std::size_t>(table.id))
+      types.resize(table.id + 1);
+
+    Entry &e = types[table.id];
+    if (e.arms.empty()) {
+      e.arms.resize(table.fields.size());
+      e.weights.assign(table.fields.size(), 1.0);
+      e.seen.assign(table.fields.size(), 0);
+      e.stamps.assign(table.fields.size(), UINT32_MAX);
+    }
+    return e;
+  }
+
+  Arm & arm(const google::protobuf::FieldDescriptor *field) {
+    return entry(GetFieldTable(*field->containing_type())).arms[field->index()];
+  }
+
+  void Credit(const MutationTag &tag, double Arm::*counter) {
+    if (!tag.field)
+      return;
+
+    arm(tag.field).*counter += 1.0;
+
+    for (int i = 0; i < tag.path.depth; i++) {
+      arm(tag.path.fields[i]).*counter += kHeatmapPathShare;
+    }
+  }
+};
+
+}
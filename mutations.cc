@@ -0,0 +1,965 @@
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <stack>
+#include <vector>
+
+#include "libprotobuf-mutator/src/utf8_fix.h"
+#include "mutations.hh"
+
+using namespace google::protobuf;
+
+namespace lpmpp {
+
+/* -------------------------------------- */
+/* --- Field utils ---------------------- */
+/* -------------------------------------- */
+
+static const int kMaxInitDepth = 16;
+
+
+/**
+ * @brief returns true if fields `a` and `b` hold values of the same type
+ * 
+ */
+static bool SameType(const FieldDescriptor &a, const FieldDescriptor &b) {
+  return a.cpp_type() == b.cpp_type() && 
+         a.message_type() == b.message_type() && 
+         a.enum_type() == b.enum_type();
+}
+
+
+/**
+ * @brief Visits every field of every message reachable from `root`, 
+ * depth-first, along with the path to the message containing it. For 
+ * repeated fields `fn` is called once with index -1 and once for each 
+ * element.
+ * 
+ */
+template<typename Fn>
+static void VisitFields(Message &root, Fn fn) {
+  struct Frame {
+    Message *msg;
+    const FieldDescriptor *via;
+    int depth;
+  };
+
+  std::stack<Frame> frames;
+  frames.push(Frame{&root, nullptr, 0});
+  FieldPath path;
+
+  while (!frames.empty()) {
+    const Frame frame = frames.top();
+    frames.pop();
+
+    // Entries between a frame and its parent belong to deeper messages, so 
+    // the prefix of the path is still that of the parent
+    if (frame.depth > 0 && frame.depth <= kMaxFieldPath)
+      path.fields[frame.depth - 1] = frame.via;
+    path.depth = std::min(frame.depth, kMaxFieldPath);
+
+    Message &msg = *frame.msg;
+    const Reflection &reflection = *msg.GetReflection();
+    const FieldTable &table = GetFieldTable(msg);
+
+    for (const FieldEntry &entry : table.fields) {
+      const FieldDescriptor *field = entry.field;
+
+      if (!entry.repeated) {
+        const bool present = !entry.presence || reflection.HasField(msg, field);
+        fn(FieldRef{&msg, field, -1, &entry, present}, path);
+
+        if (entry.message && present)
+          frames.push(Frame{reflection.MutableMessage(&msg, field), field, frame.depth + 1});
+        continue;
+      }
+
+      fn(FieldRef{&msg, field, -1, &entry, false}, path);
+
+      const int n = reflection.FieldSize(msg, field);
+      for (int j = 0; j < n; j++) {
+        fn(FieldRef{&msg, field, j, &entry, true}, path);
+
+        if (entry.message)
+          frames.push(Frame{reflection.MutableRepeatedMessage(&msg, field, j), field, frame.depth + 1});
+      }
+    }
+  }
+}
+
+
+/**
+ * @brief Sets every missing required field of `msg` to its default value,
+ * so that the message can be serialized and parsed again
+ * 
+ */
+static void InitializeRequired(Message &msg, int depth = 0) {
+  if (depth > kMaxInitDepth)
+    return;
+
+  const Descriptor &desc = *msg.GetDescriptor();
+  const Reflection &reflection = *msg.GetReflection();
+
+  for (int i = 0; i < desc.field_count(); i++) {
+    const FieldDescriptor &field = *desc.field(i);
+    if (!field.is_required())
+      continue;
+
+    switch (field.cpp_type()) {
+      case FieldDescriptor::CppType::CPPTYPE_INT32:
+        if (!reflection.HasField(msg, &field)) 
+          reflection.SetInt32(&msg, &field, field.default_value_int32());
+        break;
+      case FieldDescriptor::CppType::CPPTYPE_INT64:
+        if (!reflection.HasField(msg, &field)) 
+          reflection.SetInt64(&msg, &field, field.default_value_int64());
+        break;
+      case FieldDescriptor::CppType::CPPTYPE_UINT32:
+        if (!reflection.HasField(msg, &field)) 
+          reflection.SetUInt32(&msg, &field, field.default_value_uint32());
+        break;
+      case FieldDescriptor::CppType::CPPTYPE_UINT64:
+        if (!reflection.HasField(msg, &field)) 
+          reflection.SetUInt64(&msg, &field, field.default_value_uint64());
+        break;
+      case FieldDescriptor::CppType::CPPTYPE_DOUBLE:
+        if (!reflection.HasField(msg, &field)) 
+          reflection.SetDouble(&msg, &field, field.default_value_double());
+        break;
+      case FieldDescriptor::CppType::CPPTYPE_FLOAT:
+        if (!reflection.HasField(msg, &field)) 
+          reflection.SetFloat(&msg, &field, field.default_value_float());
+        break;
+      case FieldDescriptor::CppType::CPPTYPE_BOOL:
+        if (!reflection.HasField(msg, &field)) 
+          reflection.SetBool(&msg, &field, field.default_value_bool());
+        break;
+      case FieldDescriptor::CppType::CPPTYPE_ENUM:
+        if (!reflection.HasField(msg, &field)) 
+          reflection.SetEnum(&msg, &field, field.default_value_enum());
+        break;
+      case FieldDescriptor::CppType::CPPTYPE_STRING:
+        if (!reflection.HasField(msg, &field)) 
+          reflection.SetString(&msg, &field, field.default_value_string());
+        break;
+      case FieldDescriptor::CppType::CPPTYPE_MESSAGE:
+        InitializeRequired(*reflection.MutableMessage(&msg, &field), depth + 1);
+        break;
+    }
+  }
+}
+
+
+/**
+ * @brief Appends a default element to the repeated field `ref` and returns
+ * its index
+ * 
+ */
+static int AddDefault(const FieldRef &ref) {
+  Message &msg = *ref.msg;
+  const FieldDescriptor &field = *ref.field;
+  const Reflection &reflection = *msg.GetReflection();
+
+  switch (field.cpp_type()) {
+    case FieldDescriptor::CppType::CPPTYPE_INT32:
+      reflection.AddInt32(&msg, &field, field.default_value_int32());
+      break;
+    case FieldDescriptor::CppType::CPPTYPE_INT64:
+      reflection.AddInt64(&msg, &field, field.default_value_int64());
+      break;
+    case FieldDescriptor::CppType::CPPTYPE_UINT32:
+      reflection.AddUInt32(&msg, &field, field.default_value_uint32());
+      break;
+    case FieldDescriptor::CppType::CPPTYPE_UINT64:
+      reflection.AddUInt64(&msg, &field, field.default_value_uint64());
+      break;
+    case FieldDescriptor::CppType::CPPTYPE_DOUBLE:
+      reflection.AddDouble(&msg, &field, field.default_value_double());
+      break;
+    case FieldDescriptor::CppType::CPPTYPE_FLOAT:
+      reflection.AddFloat(&msg, &field, field.default_value_float());
+      break;
+    case FieldDescriptor::CppType::CPPTYPE_BOOL:
+      reflection.AddBool(&msg, &field, field.default_value_bool());
+      break;
+    case FieldDescriptor::CppType::CPPTYPE_ENUM:
+      reflection.AddEnum(&msg, &field, field.default_value_enum());
+      break;
+    case FieldDescriptor::CppType::CPPTYPE_STRING:
+      reflection.AddString(&msg, &field, field.default_value_string());
+      break;
+    case FieldDescriptor::CppType::CPPTYPE_MESSAGE:
+      InitializeRequired(*reflection.AddMessage(&msg, &field));
+      break;
+  }
+
+  return reflection.FieldSize(msg, &field) - 1;
+}
+
+
+/**
+ * @brief Sets the singular field `ref` to its default value
+ * 
+ */
+static void SetDefault(const FieldRef &ref) {
+  Message &msg = *ref.msg;
+  const FieldDescriptor &field = *ref.field;
+  const Reflection &reflection = *msg.GetReflection();
+
+  switch (field.cpp_type()) {
+    case FieldDescriptor::CppType::CPPTYPE_INT32:
+      return reflection.SetInt32(&msg, &field, field.default_value_int32());
+    case FieldDescriptor::CppType::CPPTYPE_INT64:
+      return reflection.SetInt64(&msg, &field, field.default_value_int64());
+    case FieldDescriptor::CppType::CPPTYPE_UINT32:
+      return reflection.SetUInt32(&msg, &field, field.default_value_uint32());
+    case FieldDescriptor::CppType::CPPTYPE_UINT64:
+      return reflection.SetUInt64(&msg, &field, field.default_value_uint64());
+    case FieldDescriptor::CppType::CPPTYPE_DOUBLE:
+      return reflection.SetDouble(&msg, &field, field.default_value_double());
+    case FieldDescriptor::CppType::CPPTYPE_FLOAT:
+      return reflection.SetFloat(&msg, &field, field.default_value_float());
+    case FieldDescriptor::CppType::CPPTYPE_BOOL:
+      return reflection.SetBool(&msg, &field, field.default_value_bool());
+    case FieldDescriptor::CppType::CPPTYPE_ENUM:
+      return reflection.SetEnum(&msg, &field, field.default_value_enum());
+    case FieldDescriptor::CppType::CPPTYPE_STRING:
+      return reflection.SetString(&msg, &field, field.default_value_string());
+    case FieldDescriptor::CppType::CPPTYPE_MESSAGE:
+      return InitializeRequired(*reflection.MutableMessage(&msg, &field));
+  }
+}
+
+
+/**
+ * @brief Copies the value of `src` to `dst`, both must have the same type. 
+ * A repeated `dst` with index -1 appends a new element.
+ * 
+ */
+static void CopyValue(const FieldRef &src, const FieldRef &dst) {
+  const Reflection &sr = *src.msg->GetReflection();
+  const Reflection &dr = *dst.msg->GetReflection();
+  const FieldDescriptor *sf = src.field;
+  const FieldDescriptor *df = dst.field;
+  Message *sm = src.msg;
+  Message *dm = dst.msg;
+
+  int index = dst.index;
+  if (df->is_repeated() && index == -1)
+    index = AddDefault(dst);
+
+  const bool srep = sf->is_repeated();
+  const bool drep = df->is_repeated();
+
+  switch (df->cpp_type()) {
+    case FieldDescriptor::CppType::CPPTYPE_INT32: {
+      auto v = srep ? sr.GetRepeatedInt32(*sm, sf, src.index) : sr.GetInt32(*sm, sf);
+      return drep ? dr.SetRepeatedInt32(dm, df, index, v) : dr.SetInt32(dm, df, v);
+    }
+    case FieldDescriptor::CppType::CPPTYPE_INT64: {
+      auto v = srep ? sr.GetRepeatedInt64(*sm, sf, src.index) : sr.GetInt64(*sm, sf);
+      return drep ? dr.SetRepeatedInt64(dm, df, index, v) : dr.SetInt64(dm, df, v);
+    }
+    case FieldDescriptor::CppType::CPPTYPE_UINT32: {
+      auto v = srep ? sr.GetRepeatedUInt32(*sm, sf, src.index) : sr.GetUInt32(*sm, sf);
+      return drep ? dr.SetRepeatedUInt32(dm, df, index, v) : dr.SetUInt32(dm, df, v);
+    }
+    case FieldDescriptor::CppType::CPPTYPE_UINT64: {
+      auto v = srep ? sr.GetRepeatedUInt64(*sm, sf, src.index) : sr.GetUInt64(*sm, sf);
+      return drep ? dr.SetRepeatedUInt64(dm, df, index, v) : dr.SetUInt64(dm, df, v);
+    }
+    case FieldDescriptor::CppType::CPPTYPE_DOUBLE: {
+      auto v = srep ? sr.GetRepeatedDouble(*sm, sf, src.index) : sr.GetDouble(*sm, sf);
+      return drep ? dr.SetRepeatedDouble(dm, df, index, v) : dr.SetDouble(dm, df, v);
+    }
+    case FieldDescriptor::CppType::CPPTYPE_FLOAT: {
+      auto v = srep ? sr.GetRepeatedFloat(*sm, sf, src.index) : sr.GetFloat(*sm, sf);
+      return drep ? dr.SetRepeatedFloat(dm, df, index, v) : dr.SetFloat(dm, df, v);
+    }
+    case FieldDescriptor::CppType::CPPTYPE_BOOL: {
+      auto v = srep ? sr.GetRepeatedBool(*sm, sf, src.index) : sr.GetBool(*sm, sf);
+      return drep ? dr.SetRepeatedBool(dm, df, index, v) : dr.SetBool(dm, df, v);
+    }
+    case FieldDescriptor::CppType::CPPTYPE_ENUM: {
+      auto v = srep ? sr.GetRepeatedEnumValue(*sm, sf, src.index) : sr.GetEnumValue(*sm, sf);
+      return drep ? dr.SetRepeatedEnumValue(dm, df, index, v) : dr.SetEnumValue(dm, df, v);
+    }
+    case FieldDescriptor::CppType::CPPTYPE_STRING: {
+      std::string v = srep ? sr.GetRepeatedString(*sm, sf, src.index) : sr.GetString(*sm, sf);
+      return drep ? dr.SetRepeatedString(dm, df, index, v) : dr.SetString(dm, df, v);
+    }
+    case FieldDescriptor::CppType::CPPTYPE_MESSAGE: {
+      // The source may contain the destination, so copy through a temporary
+      const Message &v = srep ? sr.GetRepeatedMessage(*sm, sf, src.index) : sr.GetMessage(*sm, sf);
+      std::unique_ptr<Message> tmp(v.New());
+      tmp->CopyFrom(v);
+
+      Message *m = drep ? dr.MutableRepeatedMessage(dm, df, index) : dr.MutableMessage(dm, df);
+      return m->CopyFrom(*tmp);
+    }
+  }
+}
+
+
+/**
+ * @brief returns true if `ref` holds an integer, read by GetInteger
+ * 
+ */
+static bool IsInteger(const FieldRef &ref) {
+  switch (ref.field->cpp_type()) {
+    case FieldDescriptor::CppType::CPPTYPE_INT32:
+    case FieldDescriptor::CppType::CPPTYPE_INT64:
+    case FieldDescriptor::CppType::CPPTYPE_UINT32:
+    case FieldDescriptor::CppType::CPPTYPE_UINT64:
+      return true;
+    default:
+      return false;
+  }
+}
+
+
+/**
+ * @brief returns the value of the present integer field `ref`, signed values
+ * are sign extended
+ * 
+ */
+static uint64_t GetInteger(const FieldRef &ref) {
+  const Reflection &r = *ref.msg->GetReflection();
+  const Message &m = *ref.msg;
+  const FieldDescriptor *f = ref.field;
+  const bool rep = f->is_repeated();
+
+  switch (f->cpp_type()) {
+    case FieldDescriptor::CppType::CPPTYPE_INT32:
+      return static_cast<int64_t>(rep ? r.GetRepeatedInt32(m, f, ref.index) : r.GetInt32(m, f));
+    case FieldDescriptor::CppType::CPPTYPE_INT64:
+      return rep ? r.GetRepeatedInt64(m, f, ref.index) : r.GetInt64(m, f);
+    case FieldDescriptor::CppType::CPPTYPE_UINT32:
+      return rep ? r.GetRepeatedUInt32(m, f, ref.index) : r.GetUInt32(m, f);
+    case FieldDescriptor::CppType::CPPTYPE_UINT64:
+      return rep ? r.GetRepeatedUInt64(m, f, ref.index) : r.GetUInt64(m, f);
+    default:
+      return 0;
+  }
+}
+
+
+/**
+ * @brief Sets the present integer field `ref` to `value`, truncated to the
+ * width of the field
+ * 
+ */
+static void SetInteger(const FieldRef &ref, uint64_t value) {
+  const Reflection &r = *ref.msg->GetReflection();
+  Message *m = ref.msg;
+  const FieldDescriptor *f = ref.field;
+  const bool rep = f->is_repeated();
+
+  switch (f->cpp_type()) {
+    case FieldDescriptor::CppType::CPPTYPE_INT32:
+      return rep ? r.SetRepeatedInt32(m, f, ref.index, value) : r.SetInt32(m, f, value);
+    case FieldDescriptor::CppType::CPPTYPE_INT64:
+      return rep ? r.SetRepeatedInt64(m, f, ref.index, value) : r.SetInt64(m, f, value);
+    case FieldDescriptor::CppType::CPPTYPE_UINT32:
+      return rep ? r.SetRepeatedUInt32(m, f, ref.index, value) : r.SetUInt32(m, f, value);
+    case FieldDescriptor::CppType::CPPTYPE_UINT64:
+      return rep ? r.SetRepeatedUInt64(m, f, ref.index, value) : r.SetUInt64(m, f, value);
+    default:
+      return;
+  }
+}
+
+
+/**
+ * @brief returns true if `op` can be applied to `ref`
+ * 
+ */
+static bool CanApply(MutationOp op, const FieldRef &ref) {
+  const FieldEntry &entry = *ref.entry;
+  const bool is_new = entry.repeated && ref.index == -1;
+
+  switch (op) {
+    case OP_ADD:
+      return is_new || (!entry.repeated && !ref.present);
+    case OP_DELETE:
+      return ref.present && entry.deletable;
+    case OP_REPLACE:
+      return ref.present && !entry.message;
+    case OP_COPY:
+      return ref.present || is_new;
+    case OP_CLONE:
+      return entry.repeated && ref.present;
+    case OP_CROSSOVER:
+    case OP_INJECT:
+    case NUM_OPS:
+      return false;
+  }
+
+  __builtin_unreachable();
+}
+
+
+/**
+ * @brief returns true if `op` can increase the size of the message
+ * 
+ */
+static bool IsGrowing(MutationOp op) {
+  return op == OP_ADD || op == OP_COPY || op == OP_CLONE;
+}
+
+/* -------------------------------------- */
+/* --- Mutator method definitions ------- */
+/* -------------------------------------- */
+
+static const MutationOp kMutationOps[] = {
+  OP_ADD,
+  OP_DELETE,
+  OP_REPLACE,
+  OP_COPY,
+  OP_CLONE,
+};
+
+static const int kNumMutationOps = sizeof(kMutationOps) / sizeof(kMutationOps[0]);
+
+
+const MutationTag & Mutator::MutateOne(Message &msg, std::size_t max_size, MutationOp op) {
+  const std::size_t size = msg.ByteSizeLong();
+  const bool can_grow = size < max_size;
+  
+  SetSizeHint(size, max_size);
+  tag_ = MutationTag();
+
+  // Start from the scheduled operator and fall back to the others in turn
+
+  const int first = op < kNumMutationOps ? static_cast<int>(op) 
+                                         : (*random())() % kNumMutationOps;
+
+  for (int i = 0; i < kNumMutationOps; i++) {
+    const MutationOp next = kMutationOps[(first + i) % kNumMutationOps];
+    if (!can_grow && IsGrowing(next))
+      continue;
+
+    FieldRef ref;
+    if (!SelectField(msg, next, ref, tag_.path))
+      continue;
+
+    if (!Apply(msg, next, ref))
+      continue;
+
+    tag_.op = next;
+    tag_.field = ref.field;
+    scheduler_.Chosen(tag_);
+    heatmap_.Chosen(tag_);
+    break;
+  }
+
+  return tag_;
+}
+
+
+const MutationTag & Mutator::CrossOverOne(const Message &donor, Message &msg, 
+                                          std::size_t max_size) {
+  CrossOver(donor, &msg, max_size);
+
+  tag_ = MutationTag();
+  tag_.op = OP_CROSSOVER;
+  scheduler_.Chosen(tag_);
+  return tag_;
+}
+
+
+const MutationTag & Mutator::SpliceOne(Message &msg, std::size_t max_size, 
+                                       const DonorSource &donors) {
+  SetSizeHint(msg.ByteSizeLong(), max_size);
+  tag_ = MutationTag();
+
+  // Any field a value can be copied to, set or a new repeated element
+
+  FieldRef target;
+  FieldPath path;
+  if (!SelectField(msg, OP_COPY, target, path))
+    return tag_;
+
+  Message *donor = donors(*target.field, (*random())());
+  if (!donor)
+    return tag_;
+
+  FieldRef src;
+  if (!SelectDonorField(*donor, target, src))
+    return tag_;
+
+  CopyValue(src, target);
+
+  tag_.op = OP_CROSSOVER;
+  tag_.field = target.field;
+  tag_.path = path;
+  scheduler_.Chosen(tag_);
+  heatmap_.Chosen(tag_);
+  return tag_;
+}
+
+
+const MutationTag & Mutator::InjectOne(Message &msg, std::size_t max_size, 
+                                       const CmpOperands &operands) {
+  tag_ = MutationTag();
+  if (operands.empty())
+    return tag_;
+
+  struct Candidate {
+    FieldRef ref;
+    FieldPath path;
+    const std::string *string;
+    std::size_t prefix;
+    uint64_t integer;
+    uint64_t mask;
+  };
+
+  const std::size_t size = msg.ByteSizeLong();
+  Candidate chosen;
+  uint64_t n = 0;
+  std::string scratch;
+
+  // Reservoir sampling over every operand matching a present leaf value
+
+  VisitFields(msg, [&](const FieldRef &ref, const FieldPath &path) {
+    if (!ref.present || ref.entry->message)
+      return;
+
+    if (ref.field->cpp_type() == FieldDescriptor::CppType::CPPTYPE_STRING) {
+      const Reflection &reflection = *ref.msg->GetReflection();
+      const std::string &value = ref.field->is_repeated() 
+        ? reflection.GetRepeatedStringReference(*ref.msg, ref.field, ref.index, &scratch)
+        : reflection.GetStringReference(*ref.msg, ref.field, &scratch);
+
+      operands.MatchString(value, [&](const std::string &replacement, std::size_t prefix) {
+        if (size - prefix + replacement.size() > max_size && replacement.size() > prefix)
+          return;
+        if ((*random())() % ++n == 0)
+          chosen = Candidate{ref, path, &replacement, prefix, 0, 0};
+      });
+    } else if (IsInteger(ref)) {
+      operands.MatchInteger(GetInteger(ref), [&](uint64_t replacement, uint64_t mask) {
+        if ((*random())() % ++n == 0)
+          chosen = Candidate{ref, path, nullptr, 0, replacement, mask};
+      });
+    }
+  });
+
+  if (n == 0)
+    return tag_;
+
+  const FieldRef &ref = chosen.ref;
+  const Reflection &reflection = *ref.msg->GetReflection();
+
+  if (chosen.string) {
+    std::string value = ref.field->is_repeated() 
+      ? reflection.GetRepeatedString(*ref.msg, ref.field, ref.index)
+      : reflection.GetString(*ref.msg, ref.field);
+    value.replace(0, chosen.prefix, *chosen.string);
+
+    if (ref.field->type() == FieldDescriptor::Type::TYPE_STRING)
+      protobuf_mutator::FixUtf8String(&value, random());
+
+    if (ref.field->is_repeated())
+      reflection.SetRepeatedString(ref.msg, ref.field, ref.index, std::move(value));
+    else
+      reflection.SetString(ref.msg, ref.field, std::move(value));
+  } else {
+    // Only the bytes the comparison looked at change
+    SetInteger(ref, (GetInteger(ref) & ~chosen.mask) | chosen.integer);
+  }
+
+  tag_.op = OP_INJECT;
+  tag_.field = ref.field;
+  tag_.path = chosen.path;
+  scheduler_.Chosen(tag_);
+  heatmap_.Chosen(tag_);
+  return tag_;
+}
+
+
+const MutationTag & Mutator::ReplaceWire(const WireIndex &index, std::size_t max_size, 
+                                         std::vector<uint8_t> &out, std::size_t &out_size) {
+  tag_ = MutationTag();
+
+  const std::vector<WireField> &fields = index.entries();
+  const WireField *leaf = nullptr;
+  const Descriptor *last = nullptr;
+  const double *weights = nullptr;
+  double total = 0;
+
+  for (uint32_t i : index.leaf_entries()) {
+    const FieldDescriptor *f = fields[i].field;
+    if (f->containing_type() != last) {
+      last = f->containing_type();
+      weights = heatmap_.Weights(GetFieldTable(*last));
+    }
+
+    const double weight = weights[f->index()];
+    total += weight;
+    if (Uniform(*random()) * total < weight)
+      leaf = &fields[i];
+  }
+
+  if (!leaf)
+    return tag_;
+
+  const FieldDescriptor &field = *leaf->field;
+  const uint8_t *in = index.data() + leaf->value;
+  uint8_t scalar[kMaxVarintSize];
+  std::string str;
+  const uint8_t *value = scalar;
+  std::size_t value_size = 0;
+  uint64_t raw = 0;
+
+  switch (WireTypeOf(field)) {
+    case WIRE_VARINT:
+      ReadVarint(in, in + leaf->size, raw);
+      break;
+    case WIRE_FIXED32:
+    case WIRE_FIXED64:
+      raw = LoadFixed(in, leaf->size);
+      break;
+    default:
+      break;
+  }
+
+  switch (field.type()) {
+    case FieldDescriptor::TYPE_INT32:
+    case FieldDescriptor::TYPE_SFIXED32:
+      // Negative int32 varints are sign-extended to 64 bits
+      raw = static_cast<int64_t>(MutateInt32(static_cast<int32_t>(raw)));
+      break;
+    case FieldDescriptor::TYPE_SINT32:
+      raw = ZigZagEncode(MutateInt32(static_cast<int32_t>(ZigZagDecode(raw))));
+      break;
+    case FieldDescriptor::TYPE_INT64:
+    case FieldDescriptor::TYPE_SFIXED64:
+      raw = MutateInt64(static_cast<int64_t>(raw));
+      break;
+    case FieldDescriptor::TYPE_SINT64:
+      raw = ZigZagEncode(MutateInt64(ZigZagDecode(raw)));
+      break;
+    case FieldDescriptor::TYPE_UINT32:
+    case FieldDescriptor::TYPE_FIXED32:
+      raw = MutateUInt32(static_cast<uint32_t>(raw));
+      break;
+    case FieldDescriptor::TYPE_UINT64:
+    case FieldDescriptor::TYPE_FIXED64:
+      raw = MutateUInt64(raw);
+      break;
+    case FieldDescriptor::TYPE_FLOAT: {
+      float v;
+      const uint32_t bits = raw;
+      memcpy(&v, &bits, sizeof(v));
+      v = MutateFloat(v);
+      uint32_t mutated;
+      memcpy(&mutated, &v, sizeof(v));
+      raw = mutated;
+      break;
+    }
+    case FieldDescriptor::TYPE_DOUBLE: {
+      double v;
+      memcpy(&v, &raw, sizeof(v));
+      v = MutateDouble(v);
+      memcpy(&raw, &v, sizeof(v));
+      break;
+    }
+    case FieldDescriptor::TYPE_BOOL:
+      raw = MutateBool(raw != 0);
+      break;
+    case FieldDescriptor::TYPE_ENUM: {
+      const EnumDescriptor &type = *field.enum_type();
+      const EnumValueDescriptor *v = type.FindValueByNumber(static_cast<int32_t>(raw));
+      const int i = MutateEnum(v ? v->index() : 0, type.value_count());
+      raw = static_cast<int64_t>(type.value(i)->number());
+      break;
+    }
+    case FieldDescriptor::TYPE_STRING:
+    case FieldDescriptor::TYPE_BYTES:
+      SetSizeHint(index.size(), max_size);
+      str = MutateStringValue(field, std::string(reinterpret_cast<const char *>(in), leaf->size));
+      if (field.type() == FieldDescriptor::TYPE_STRING)
+        protobuf_mutator::FixUtf8String(&str, random());
+
+      value = reinterpret_cast<const uint8_t *>(str.data());
+      value_size = str.size();
+      break;
+    default:
+      return tag_;
+  }
+
+  switch (WireTypeOf(field)) {
+    case WIRE_VARINT:
+      value_size = WriteVarint(raw, scalar);
+      break;
+    case WIRE_FIXED32:
+    case WIRE_FIXED64:
+      value_size = leaf->size;
+      StoreFixed(raw, scalar, value_size);
+      break;
+    default:
+      break;
+  }
+
+  if (index.RewrittenSize(*leaf, value_size) > max_size)
+    return tag_;
+
+  out_size = index.Rewrite(*leaf, value, value_size, out);
+
+  // The path holds the enclosing message fields, outermost first
+  int depth = 0;
+  for (int32_t i = leaf->parent; i >= 0; i = fields[i].parent)
+    depth++;
+
+  tag_.op = OP_REPLACE;
+  tag_.field = &field;
+  tag_.path.depth = std::min(depth, kMaxFieldPath);
+  for (int32_t i = leaf->parent; i >= 0; i = fields[i].parent) {
+    if (--depth < kMaxFieldPath)
+      tag_.path.fields[depth] = fields[i].field;
+  }
+
+  scheduler_.Chosen(tag_);
+  heatmap_.Chosen(tag_);
+  return tag_;
+}
+
+
+bool Mutator::SelectField(Message &msg, MutationOp op, FieldRef &ref, FieldPath &path) {
+  const Message *last = nullptr;
+  const double *weights = nullptr;
+  double total = 0;
+
+  // Weighted reservoir sampling over all fields the operator applies to
+
+  VisitFields(msg, [&](const FieldRef &candidate, const FieldPath &candidate_path) {
+    if (!CanApply(op, candidate))
+      return;
+
+    if (candidate.msg != last) {
+      last = candidate.msg;
+      weights = heatmap_.Weights(GetFieldTable(*candidate.msg));
+    }
+
+    const double weight = weights[candidate.entry->index];
+    total += weight;
+    if (Uniform(*random()) * total < weight) {
+      ref = candidate;
+      path = candidate_path;
+    }
+  });
+
+  return total > 0;
+}
+
+
+bool Mutator::SelectSource(Message &msg, const FieldRef &target, FieldRef &ref) {
+  uint64_t n = 0;
+
+  VisitFields(msg, [&](const FieldRef &candidate, const FieldPath &) {
+    if (!SameType(*candidate.field, *target.field))
+      return;
+
+    if (!candidate.present)
+      return;
+
+    if (candidate.msg == target.msg && candidate.field == target.field && 
+        candidate.index == target.index)
+      return;
+
+    if ((*random())() % ++n == 0)
+      ref = candidate;
+  });
+
+  return n > 0;
+}
+
+
+bool Mutator::SelectDonorField(Message &donor, const FieldRef &target, FieldRef &ref) {
+  uint64_t n = 0;
+
+  VisitFields(donor, [&](const FieldRef &candidate, const FieldPath &) {
+    if (candidate.field != target.field || !candidate.present)
+      return;
+
+    if ((*random())() % ++n == 0)
+      ref = candidate;
+  });
+
+  return n > 0;
+}
+
+
+bool Mutator::Apply(Message &msg, MutationOp op, const FieldRef &ref) {
+  switch (op) {
+    case OP_ADD:
+      Add(ref);
+      return true;
+    case OP_DELETE:
+      Delete(ref);
+      return true;
+    case OP_REPLACE:
+      Replace(ref);
+      return true;
+    case OP_COPY: {
+      FieldRef src;
+      if (!SelectSource(msg, ref, src))
+        return false;
+      CopyValue(src, ref);
+      return true;
+    }
+    case OP_CLONE:
+      Clone(ref);
+      return true;
+    case OP_CROSSOVER:
+    case OP_INJECT:
+    case NUM_OPS:
+      return false;
+  }
+
+  __builtin_unreachable();
+}
+
+
+void Mutator::Add(const FieldRef &ref) {
+  FieldRef added = ref;
+
+  if (ref.field->is_repeated()) {
+    added.index = AddDefault(ref);
+  } else {
+    SetDefault(ref);
+  }
+
+  if (ref.field->cpp_type() != FieldDescriptor::CppType::CPPTYPE_MESSAGE)
+    Replace(added);
+}
+
+
+void Mutator::Delete(const FieldRef &ref) {
+  const Reflection &reflection = *ref.msg->GetReflection();
+
+  if (!ref.field->is_repeated())
+    return reflection.ClearField(ref.msg, ref.field);
+
+  // Move the element to the end, preserving the order of the others
+
+  const int n = reflection.FieldSize(*ref.msg, ref.field);
+  for (int i = ref.index; i < n - 1; i++) {
+    reflection.SwapElements(ref.msg, ref.field, i, i + 1);
+  }
+  reflection.RemoveLast(ref.msg, ref.field);
+}
+
+
+void Mutator::Replace(const FieldRef &ref) {
+  Message &msg = *ref.msg;
+  const FieldDescriptor &field = *ref.field;
+  const Reflection &reflection = *msg.GetReflection();
+  const bool rep = field.is_repeated();
+  const int i = ref.index;
+
+  switch (field.cpp_type()) {
+    case FieldDescriptor::CppType::CPPTYPE_INT32: {
+      auto v = MutateInt32(rep ? reflection.GetRepeatedInt32(msg, &field, i) 
+                               : reflection.GetInt32(msg, &field));
+      return rep ? reflection.SetRepeatedInt32(&msg, &field, i, v) 
+                 : reflection.SetInt32(&msg, &field, v);
+    }
+    case FieldDescriptor::CppType::CPPTYPE_INT64: {
+      auto v = MutateInt64(rep ? reflection.GetRepeatedInt64(msg, &field, i) 
+                               : reflection.GetInt64(msg, &field));
+      return rep ? reflection.SetRepeatedInt64(&msg, &field, i, v) 
+                 : reflection.SetInt64(&msg, &field, v);
+    }
+    case FieldDescriptor::CppType::CPPTYPE_UINT32: {
+      auto v = MutateUInt32(rep ? reflection.GetRepeatedUInt32(msg, &field, i) 
+                                : reflection.GetUInt32(msg, &field));
+      return rep ? reflection.SetRepeatedUInt32(&msg, &field, i, v) 
+                 : reflection.SetUInt32(&msg, &field, v);
+    }
+    case FieldDescriptor::CppType::CPPTYPE_UINT64: {
+      auto v = MutateUInt64(rep ? reflection.GetRepeatedUInt64(msg, &field, i) 
+                                : reflection.GetUInt64(msg, &field));
+      return rep ? reflection.SetRepeatedUInt64(&msg, &field, i, v) 
+                 : reflection.SetUInt64(&msg, &field, v);
+    }
+    case FieldDescriptor::CppType::CPPTYPE_DOUBLE: {
+      auto v = MutateDouble(rep ? reflection.GetRepeatedDouble(msg, &field, i) 
+                                : reflection.GetDouble(msg, &field));
+      return rep ? reflection.SetRepeatedDouble(&msg, &field, i, v) 
+                 : reflection.SetDouble(&msg, &field, v);
+    }
+    case FieldDescriptor::CppType::CPPTYPE_FLOAT: {
+      auto v = MutateFloat(rep ? reflection.GetRepeatedFloat(msg, &field, i) 
+                               : reflection.GetFloat(msg, &field));
+      return rep ? reflection.SetRepeatedFloat(&msg, &field, i, v) 
+                 : reflection.SetFloat(&msg, &field, v);
+    }
+    case FieldDescriptor::CppType::CPPTYPE_BOOL: {
+      auto v = MutateBool(rep ? reflection.GetRepeatedBool(msg, &field, i) 
+                              : reflection.GetBool(msg, &field));
+      return rep ? reflection.SetRepeatedBool(&msg, &field, i, v) 
+                 : reflection.SetBool(&msg, &field, v);
+    }
+    case FieldDescriptor::CppType::CPPTYPE_ENUM: {
+      const EnumValueDescriptor *value = rep ? reflection.GetRepeatedEnum(msg, &field, i) 
+                                             : reflection.GetEnum(msg, &field);
+      const EnumDescriptor &type = *field.enum_type();
+      const EnumValueDescriptor *v = type.value(MutateEnum(value->index(), type.value_count()));
+      return rep ? reflection.SetRepeatedEnum(&msg, &field, i, v) 
+                 : reflection.SetEnum(&msg, &field, v);
+    }
+    case FieldDescriptor::CppType::CPPTYPE_STRING: {
+      std::string v = MutateStringValue(field, rep ? reflection.GetRepeatedString(msg, &field, i) 
+                                                   : reflection.GetString(msg, &field));
+      if (field.type() == FieldDescriptor::Type::TYPE_STRING)
+        protobuf_mutator::FixUtf8String(&v, random());
+
+      return rep ? reflection.SetRepeatedString(&msg, &field, i, v) 
+                 : reflection.SetString(&msg, &field, v);
+    }
+    case FieldDescriptor::CppType::CPPTYPE_MESSAGE:
+      return;
+  }
+}
+
+
+std::string Mutator::MutateStringValue(const FieldDescriptor &field, const std::string &value) {
+  const std::string *token = nullptr;
+  if (!dictionary_.empty() && Uniform(*random()) < kTokenShare)
+    token = dictionary_.Choose(field, (*random())());
+
+  if (!token)
+    return MutateString(value, size_increase_hint);
+
+  std::string v = value;
+  const std::size_t pos = (*random())() % (v.size() + 1);
+  const bool fits = token->size() <= static_cast<std::size_t>(size_increase_hint);
+
+  switch ((*random())() % 3) {
+    case 0:
+      if (fits) {
+        v.insert(pos, *token);
+        break;
+      }
+      [[fallthrough]];
+    case 1:
+      v.replace(pos, token->size(), *token);
+      break;
+    default:
+      v = *token;
+      break;
+  }
+
+  return v;
+}
+
+
+void Mutator::Clone(const FieldRef &ref) {
+  FieldRef dst = ref;
+  dst.index = -1;
+  CopyValue(ref, dst);
+}
+
+}
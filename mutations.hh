@@ -0,0 +1,380 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <string>
+#include <google/protobuf/message.h>
+
+#include "libprotobuf-mutator/src/mutator.h"
+#include "libprotobuf-mutator/src/utf8_fix.h"
+#include "cmplog.hh"
+#include "dictionary.hh"
+#include "fieldtable.hh"
+#include "heatmap.hh"
+#include "operators.hh"
+#include "scheduler.hh"
+#include "visitor.hh"
+#include "wire.hh"
+
+namespace lpmpp {
+
+/**
+ * @brief A field of a message, or an element of a repeated field. For 
+ * repeated fields an index of -1 refers to a new element.
+ * 
+ */
+struct FieldRef {
+  google::protobuf::Message *msg;
+  const google::protobuf::FieldDescriptor *field;
+  int index;
+  const FieldEntry *entry = nullptr;
+  bool present = false;
+};
+
+
+/**
+ * @brief Returns a message containing the given field to splice from, or 
+ * nullptr if there is none. The second argument is a random number to 
+ * choose among candidates with.
+ * 
+ */
+using DonorSource = std::function<google::protobuf::Message *(const google::protobuf::FieldDescriptor &, 
+                                                              uint64_t)>;
+
+
+/**
+ * @brief Structure-aware mutator. Chooses a mutation operator and a target
+ * field itself so that every mutant can be tagged, and uses the value 
+ * mutations and crossover of libprotobuf-mutator. Operators are chosen by
+ * the scheduler and target fields are weighted by the field heatmap, both
+ * according to their yields.
+ * 
+ * Message types with traits generated by protoc-gen-lpmpp replace values 
+ * through their generated accessors, the other operators and all other
+ * types go through Reflection.
+ * 
+ */
+class Mutator : public protobuf_mutator::Mutator {
+private:
+  MutationTag tag_;
+  Scheduler scheduler_;
+  FieldHeatmap heatmap_;
+  Dictionary dictionary_;
+  int size_increase_hint = 0;
+
+public:
+  /**
+   * @brief Draws the next operator from the scheduler
+   * 
+   */
+  MutationOp NextOp() {
+    return scheduler_.Next(*random());
+  }
+
+  /**
+   * @brief returns true with probability `p`
+   * 
+   */
+  bool Chance(double p) {
+    return Uniform(*random()) < p;
+  }
+
+  /**
+   * @brief Applies a single mutation to `msg`, using `op` if it applies to
+   * any field and another operator otherwise. Operators that grow the 
+   * message are not used once it exceeds `max_size`.
+   * 
+   * @return the tag of the applied mutation, invalid if none could be applied
+   */
+  const MutationTag & MutateOne(google::protobuf::Message &msg, std::size_t max_size, 
+                                MutationOp op);
+
+  /**
+   * @brief Applies a single mutation to `msg`, replacing values without
+   * Reflection
+   * 
+   */
+  template<Specialized T>
+  const MutationTag & MutateOne(T &msg, std::size_t max_size, MutationOp op);
+
+  /**
+   * @brief Merges parts of `donor` into `msg`
+   * 
+   */
+  const MutationTag & CrossOverOne(const google::protobuf::Message &donor, 
+                                   google::protobuf::Message &msg, std::size_t max_size);
+
+  /**
+   * @brief Splices a field of a donor into `msg`: chooses a target field,
+   * weighted by the field heatmap, and copies the same field of a donor 
+   * from `donors` over it, or appends it to a repeated field. Tagged as a
+   * crossover of the target field.
+   * 
+   * @return the tag of the splice, invalid if there was no donor
+   */
+  const MutationTag & SpliceOne(google::protobuf::Message &msg, std::size_t max_size, 
+                                const DonorSource &donors);
+
+  /**
+   * @brief Sets a present leaf field of `msg` which holds one operand of a
+   * comparison in `operands` to the other operand: a string or bytes field
+   * starting with the operand has that prefix replaced, an integer field 
+   * has its low bytes replaced. Tagged as an injection into the field.
+   * 
+   * @return the tag of the injection, invalid if no field matched
+   */
+  const MutationTag & InjectOne(google::protobuf::Message &msg, std::size_t max_size, 
+                                const CmpOperands &operands);
+
+  /**
+   * @brief Replaces a leaf value of the input indexed by `index` in its 
+   * serialized form, weighted by the field heatmap, and writes the mutant
+   * to `out`. Tagged as a replacement of the field.
+   * 
+   * @param out_size set to the size of the mutant
+   * @return the tag of the replacement, invalid if the input has no leaf or
+   * the mutant would exceed `max_size`
+   */
+  const MutationTag & ReplaceWire(const WireIndex &index, std::size_t max_size, 
+                                  std::vector<uint8_t> &out, std::size_t &out_size);
+
+  /**
+   * @brief Records that the last mutant produced a new queue entry
+   * 
+   */
+  void Credit() {
+    if (tag_.valid()) {
+      scheduler_.Reward(tag_);
+      heatmap_.Reward(tag_);
+    }
+    tag_ = MutationTag();
+  }
+
+  const MutationTag & tag() const {
+    return tag_;
+  }
+
+  /**
+   * @brief Restores the tag of an earlier mutation, to credit it rather
+   * than the mutations applied after it
+   * 
+   */
+  void set_tag(const MutationTag &tag) {
+    tag_ = tag;
+  }
+
+  const Scheduler & scheduler() const {
+    return scheduler_;
+  }
+
+  Scheduler & scheduler() {
+    return scheduler_;
+  }
+
+  FieldHeatmap & heatmap() {
+    return heatmap_;
+  }
+
+  Dictionary & dictionary() {
+    return dictionary_;
+  }
+
+private:
+  /**
+   * @brief Chooses the target of `op` from all fields of `msg` for which 
+   * the operator applies, weighted by the field heatmap, and stores the path
+   * to it in `path`. Returns false if there are none.
+   * 
+   */
+  bool SelectField(google::protobuf::Message &msg, MutationOp op, FieldRef &ref, 
+                   FieldPath &path);
+
+  /**
+   * @brief Chooses a present field, other than `target`, with the same type
+   * as `target`. Returns false if there are none.
+   * 
+   */
+  bool SelectSource(google::protobuf::Message &msg, const FieldRef &target, FieldRef &ref);
+
+  /**
+   * @brief Chooses a present element of the field of `target` in `donor`.
+   * Returns false if there are none.
+   * 
+   */
+  bool SelectDonorField(google::protobuf::Message &donor, const FieldRef &target, FieldRef &ref);
+
+  bool Apply(google::protobuf::Message &msg, MutationOp op, const FieldRef &ref);
+
+  /**
+   * @brief Tracks the path to the message being visited by a typed visitor
+   * 
+   */
+  struct TypedPath {
+    FieldPath path;
+    int depth = 0;
+
+    void Enter(const google::protobuf::FieldDescriptor *field) {
+      if (depth < kMaxFieldPath)
+        path.fields[depth] = field;
+      path.depth = std::min(++depth, kMaxFieldPath);
+    }
+
+    void Leave() {
+      path.depth = std::min(--depth, kMaxFieldPath);
+    }
+  };
+
+  /**
+   * @brief Chooses a value to replace among all set leaf fields, weighted 
+   * by the field heatmap
+   * 
+   */
+  struct LeafSelector : TypedPath {
+    Mutator &mutator;
+    const google::protobuf::Descriptor *last = nullptr;
+    const double *weights = nullptr;
+    double total = 0;
+    int n = 0;
+    int chosen = -1;
+    const google::protobuf::FieldDescriptor *field = nullptr;
+    FieldPath chosen_path;
+
+    LeafSelector(Mutator &mutator) : mutator(mutator) {}
+
+    void Leaf(const google::protobuf::FieldDescriptor *f) {
+      if (f->containing_type() != last) {
+        last = f->containing_type();
+        weights = mutator.heatmap_.Weights(GetFieldTable(*last));
+      }
+
+      const double weight = weights[f->index()];
+      total += weight;
+      if (Uniform(*mutator.random()) * total < weight) {
+        chosen = n;
+        field = f;
+        chosen_path = path;
+      }
+      n++;
+    }
+
+    template<typename V, typename Set>
+    void Value(const google::protobuf::FieldDescriptor *f, V, Set) { Leaf(f); }
+
+    template<typename Set>
+    void Enum(const google::protobuf::FieldDescriptor *f, int, Set) { Leaf(f); }
+
+    void String(const google::protobuf::FieldDescriptor *f, std::string &) { Leaf(f); }
+
+    template<typename M>
+    void Message(const google::protobuf::FieldDescriptor *f, M &msg) {
+      if constexpr (Specialized<M>) {
+        Enter(f);
+        VisitTyped(msg, *this);
+        Leave();
+      }
+    }
+  };
+
+  /**
+   * @brief Replaces the `target`th leaf value, in visiting order
+   * 
+   */
+  struct LeafReplacer {
+    Mutator &mutator;
+    int target;
+    int n = 0;
+
+    template<typename V, typename Set>
+    void Value(const google::protobuf::FieldDescriptor *, V value, Set set) {
+      if (n++ == target)
+        set(mutator.MutateValue(value));
+    }
+
+    template<typename Set>
+    void Enum(const google::protobuf::FieldDescriptor *f, int number, Set set) {
+      if (n++ != target)
+        return;
+
+      const google::protobuf::EnumDescriptor &type = *f->enum_type();
+      const google::protobuf::EnumValueDescriptor *value = type.FindValueByNumber(number);
+      const int index = mutator.MutateEnum(value ? value->index() : 0, type.value_count());
+      set(type.value(index)->number());
+    }
+
+    void String(const google::protobuf::FieldDescriptor *f, std::string &value) {
+      if (n++ != target)
+        return;
+
+      value = mutator.MutateStringValue(*f, value);
+      if (f->type() == google::protobuf::FieldDescriptor::Type::TYPE_STRING)
+        protobuf_mutator::FixUtf8String(&value, mutator.random());
+    }
+
+    template<typename M>
+    void Message(const google::protobuf::FieldDescriptor *, M &msg) {
+      if constexpr (Specialized<M>) {
+        if (n <= target)
+          VisitTyped(msg, *this);
+      }
+    }
+  };
+
+  int32_t MutateValue(int32_t value) { return MutateInt32(value); }
+  int64_t MutateValue(int64_t value) { return MutateInt64(value); }
+  uint32_t MutateValue(uint32_t value) { return MutateUInt32(value); }
+  uint64_t MutateValue(uint64_t value) { return MutateUInt64(value); }
+  double MutateValue(double value) { return MutateDouble(value); }
+  float MutateValue(float value) { return MutateFloat(value); }
+  bool MutateValue(bool value) { return MutateBool(value); }
+
+  /**
+   * @brief Mutates a value of `field`, inserting, overwriting with or 
+   * replacing it by a token of the dictionary in kTokenShare of the cases
+   * 
+   */
+  std::string MutateStringValue(const google::protobuf::FieldDescriptor &field, 
+                                const std::string &value);
+
+  void SetSizeHint(std::size_t size, std::size_t max_size) {
+    size_increase_hint = size < max_size ? std::min<std::size_t>(max_size - size, 
+                                                                 std::numeric_limits<int>::max()) : 0;
+  }
+
+  void Add(const FieldRef &ref);
+  void Delete(const FieldRef &ref);
+  void Replace(const FieldRef &ref);
+  void Clone(const FieldRef &ref);
+};
+
+
+template<Specialized T>
+const MutationTag & Mutator::MutateOne(T &msg, std::size_t max_size, MutationOp op) {
+  if (op != OP_REPLACE)
+    return MutateOne(static_cast<google::protobuf::Message &>(msg), max_size, op);
+
+  // Choose a leaf in a first pass, then replace it in a second one
+
+  LeafSelector selector(*this);
+  VisitTyped(msg, selector);
+
+  if (selector.n == 0)
+    return MutateOne(static_cast<google::protobuf::Message &>(msg), max_size, op);
+
+  SetSizeHint(msg.ByteSizeLong(), max_size);
+
+  LeafReplacer replacer{*this, selector.chosen};
+  VisitTyped(msg, replacer);
+
+  tag_ = MutationTag();
+  tag_.op = OP_REPLACE;
+  tag_.field = selector.field;
+  tag_.path = selector.chosen_path;
+  scheduler_.Chosen(tag_);
+  heatmap_.Chosen(tag_);
+  return tag_;
+}
+
+}
@@ -1,35 +1,175 @@
+#include <algorithm>
 #include <cstdint>
+#include <cstdio>
 #include <stdexcept>
 #include <iostream>
 #include <sstream>
 #include <stdlib.h>
+#include <google/protobuf/arena.h>
 #include <google/protobuf/message.h>
 #include <afl/afl-fuzz.h>
 #include <afl/alloc-inl.h>
 
-#include "libprotobuf-mutator/src/mutator.h"
+#include "bloat.hh"
+#include "cmplog.hh"
+#include "dedup.hh"
+#include "mutations.hh"
+#include "queue.hh"
+#include "schema.hh"
 #include "statistics.hh"
+#include "timing.hh"
 #include "trimming.hh"
 #include "utils.hh"
+#include "wire.hh"
 
 
 namespace lpmpp {
 
-class Mutator : public protobuf_mutator::Mutator {
-  
+// Size of the arena block kept across calls to fuzz and post_process
+static const std::size_t kArenaBlockSize = 1 << 16;
+// Size of the buffer returned by describe and introspection
+static const std::size_t kDescriptionSize = 256;
+// Percentage of AFL++ havoc mutations replaced by havoc_mutation. Higher than
+// the default of 6, byte-level mutations rarely leave the wire format valid
+static const uint8_t kHavocProbability = 25;
+// Selections between adding the automatic tokens of AFL++ again, once it 
+// replaces them in place
+static const uint32_t kAutoExtrasResync = 64;
+
+
+/**
+ * @brief The last input parsed by fuzz. AFL++ calls fuzz many times in a 
+ * row with the same queue entry, a hit copies the cached message instead
+ * of parsing the input again.
+ * 
+ */
+class ParseCache {
+private:
+  std::string input;
+  std::unique_ptr<google::protobuf::Message> message;
+  bool valid = false;
+
+public:
+  /**
+   * @brief Parses `buf` into `out`, returns false if it is not a valid `T`
+   * 
+   */
+  template<Derived<google::protobuf::Message> T>
+  bool Parse(const uint8_t *buf, std::size_t size, T &out) {
+    if (valid && size == input.size() && memcmp(buf, input.data(), size) == 0) {
+      if (!message)
+        return false;
+
+      out.CopyFrom(static_cast<const T &>(*message));
+      return true;
+    }
+
+    input.assign(reinterpret_cast<const char *>(buf), size);
+    valid = true;
+
+    if (!out.ParseFromArray(buf, size)) {
+      message.reset();
+      return false;
+    }
+
+    if (!message || message->GetDescriptor() != out.GetDescriptor())
+      message.reset(out.New());
+
+    static_cast<T &>(*message).CopyFrom(out);
+    return true;
+  }
 };
 
+
+/**
+ * @brief How the last mutant was produced: operator, path of field numbers
+ * to the mutated field and the queue entry of the crossover donor. Recording
+ * copies the tag, the text is only formatted when AFL++ asks for it.
+ * 
+ */
+class MutantDescription {
+private:
+  MutationTag tag;
+  int32_t donor = -1;
+  char text[kDescriptionSize];
+
+public:
+  void Record(const MutationTag &tag, int32_t donor) {
+    this->tag = tag;
+    this->donor = donor;
+  }
+
+  /**
+   * @brief returns e.g. "lpm:replace,path:2.1,donor:17", at most `max_len`
+   * characters long, or nullptr if no mutant was recorded
+   * 
+   */
+  const char * Format(std::size_t max_len) {
+    if (!tag.valid())
+      return nullptr;
+
+    const std::size_t size = std::min(max_len + 1, sizeof(text));
+    std::size_t n = 0;
+
+    auto append = [&](const char *format, auto... args) {
+      if (n < size)
+        n += std::max(0, snprintf(text + n, size - n, format, args...));
+    };
+
+    append("lpm:%s", MutationOpDesc[tag.op]);
+
+    if (tag.field) {
+      append("%s", ",path:");
+      for (int i = 0; i < tag.path.depth; i++)
+        append("%d.", tag.path.fields[i]->number());
+      append("%d", tag.field->number());
+    }
+
+    if (donor >= 0)
+      append(",donor:%d", donor);
+
+    return text;
+  }
+};
+
+
 class MutatorState {
 private:
+  // Declared first, messages of a dynamic schema must not outlive it
+  std::unique_ptr<DynamicSchema> schema_;
+  afl_state_t *afl_ = nullptr;
   std::vector<uint8_t> buf_;
   std::size_t bufsize_ = 0;
+  std::unique_ptr<char[]> arena_block_;
+  google::protobuf::Arena arena_;
+  ParseCache parse_cache_;
+  WireIndex wire_index_;
+  MutantFilter mutant_filter_;
+  double wire_share_ = kWireShare;
+  QueueIndex queue_index_;
+  SplicePool splice_pool_;
+  DonorCache donor_cache_;
+  TimingModel timing_;
+  BloatDetector bloat_;
+  CmpOperands cmp_operands_;
+  bool cmplog_stale_ = true;
+  // Tokens of AFL++ already added to the dictionary, and selections since
+  uint32_t extras_synced_ = 0;
+  uint32_t auto_extras_synced_ = 0;
+  uint32_t extras_age_ = 0;
+  MutantDescription description_;
+  std::string encoded_;
+  TrimHistory trim_history_;
   std::unique_ptr<Trimmer> trimmer_;
   MutatorStats stats_;
   Mutator mutator_;
   int trimindex_;
 
 public:
-  MutatorState(unsigned int seed) {
+  MutatorState(unsigned int seed) : 
+    arena_block_(new char[kArenaBlockSize]),
+    arena_(ArenaOptions(arena_block_.get())) {
+    
     mutator_.Seed(seed);
   }
 
@@ -41,6 +181,18 @@ public:
     return bufsize_;
   }
 
+  /**
+   * @brief The schema loaded by init_dynamic, or nullptr
+   * 
+   */
+  const DynamicSchema * schema() const {
+    return schema_.get();
+  }
+
+  void set_schema(std::unique_ptr<DynamicSchema> schema) {
+    schema_ = std::move(schema);
+  }
+
   Trimmer * trimmer() const {
     return trimmer_.get();
   }
@@ -49,6 +201,10 @@ public:
     trimmer_ = std::move(trimmer);
   }
 
+  TrimHistory & trim_history() {
+    return trim_history_;
+  }
+
   MutatorStats & stats()  {
     return stats_;
   }
@@ -57,6 +213,124 @@ public:
     return mutator_;
   }
 
+  /**
+   * @brief Arena for the messages of a single call, the first block is 
+   * reused so that small messages never allocate
+   * 
+   */
+  google::protobuf::Arena & arena() {
+    return arena_;
+  }
+
+  ParseCache & parse_cache() {
+    return parse_cache_;
+  }
+
+  QueueIndex & queue_index() {
+    return queue_index_;
+  }
+
+  SplicePool & splice_pool() {
+    return splice_pool_;
+  }
+
+  DonorCache & donor_cache() {
+    return donor_cache_;
+  }
+
+  TimingModel & timing() {
+    return timing_;
+  }
+
+  WireIndex & wire_index() {
+    return wire_index_;
+  }
+
+  /**
+   * @brief Hashes of the recent mutants
+   * 
+   */
+  MutantFilter & mutant_filter() {
+    return mutant_filter_;
+  }
+
+  /**
+   * @brief returns the share of value replacements applied to the 
+   * serialized input directly
+   * 
+   */
+  double wire_share() const {
+    return wire_share_;
+  }
+
+  void set_wire_share(double share) {
+    wire_share_ = share;
+  }
+
+  BloatDetector & bloat() {
+    return bloat_;
+  }
+
+  /**
+   * @brief Comparison operands logged for the entry being fuzzed
+   * 
+   */
+  CmpOperands & cmp_operands() {
+    return cmp_operands_;
+  }
+
+  /**
+   * @brief true if the cmplog map may hold the comparisons of an entry 
+   * selected since cmp_operands was filled
+   * 
+   */
+  bool cmplog_stale() const {
+    return cmplog_stale_;
+  }
+
+  void set_cmplog_stale(bool stale) {
+    cmplog_stale_ = stale;
+  }
+
+  uint32_t extras_synced() const {
+    return extras_synced_;
+  }
+
+  uint32_t auto_extras_synced() const {
+    return auto_extras_synced_;
+  }
+
+  void set_extras_synced(uint32_t extras, uint32_t auto_extras) {
+    extras_synced_ = extras;
+    auto_extras_synced_ = auto_extras;
+    extras_age_ = 0;
+  }
+
+  /**
+   * @brief Counts a selection, returns the selections since the tokens of
+   * AFL++ were added
+   * 
+   */
+  uint32_t age_extras() {
+    return ++extras_age_;
+  }
+
+  MutantDescription & description() {
+    return description_;
+  }
+
+  afl_state_t * afl() const {
+    return afl_;
+  }
+
+  void set_afl(afl_state_t *afl) {
+    afl_ = afl;
+  }
+
+  std::string & encoded() {
+    return encoded_;
+  }
+
   int trimindex() const {
     return trimindex_;
   }
@@ -75,35 +349,124 @@ public:
     return size;
   }
 
+  /**
+   * @brief Serializes `msg` straight into the output buffer
+   * 
+   */
+  std::size_t Serialize(const google::protobuf::Message &msg) {
+    const std::size_t size = msg.ByteSizeLong();
+    if (buf_.size() < size) {
+      buf_.resize(size);
+    }
+
+    bufsize_ = size;
+    msg.SerializeWithCachedSizesToArray(buf_.data());
+    return size;
+  }
+
+  /**
+   * @brief Replaces a leaf value of the input indexed by `index` straight 
+   * into the output buffer, returns false if no mutant was written
+   * 
+   */
+  bool ReplaceWire(const WireIndex &index, std::size_t max_size) {
+    std::size_t size = 0;
+    if (!mutator_.ReplaceWire(index, max_size, buf_, size).valid())
+      return false;
+
+    bufsize_ = size;
+    return true;
+  }
+
   MutatorState& operator=(MutatorState& other) = delete;
   MutatorState& operator=(MutatorState&& other) = delete;
+
+private:
+  static google::protobuf::ArenaOptions ArenaOptions(char *block) {
+    google::protobuf::ArenaOptions options;
+    options.initial_block = block;
+    options.initial_block_size = kArenaBlockSize;
+    return options;
+  }
 };
 
 
-void Mutate(MutatorState *state, google::protobuf::Message &value, 
-              std::size_t max_size) {
-  /* From libprotobuf-mutator source: "Method does not guarantee
-  that real result will be strictly smaller than value. Caller
-  should repeat mutation if result was larger than expected" */
+/**
+ * @brief Resets the arena of `state` when going out of scope
+ * 
+ */
+class ArenaScope {
+private:
+  google::protobuf::Arena &arena;
+
+public:
+  ArenaScope(google::protobuf::Arena &arena) : arena(arena) {}
+
+  ~ArenaScope() {
+    arena.Reset();
+  }
+};
+
+
+template<Derived<google::protobuf::Message> T>
+void Mutate(MutatorState *state, T &value, std::size_t max_size, MutationOp op) {
+  /* Value mutations do not guarantee that the result is strictly
+  smaller than max_size, so repeat until it fits. Once the message
+  is too large only shrinking operators are chosen */
 
   int i = 0;
 
   do {
-    state->mutator().Mutate(&value, max_size);
+    const uint64_t start = state->stats().clock();
+    const MutationTag &tag = state->mutator().MutateOne(value, max_size, op);
+    if (tag.valid()) {
+      state->stats().record_op(tag.op, start);
+      state->stats().inc_op_chosen(tag.op);
+    }
+    op = state->mutator().NextOp();
   } while(value.ByteSizeLong() > max_size && ++i < 10);
 }
 
-inline bool ShouldCrossover() {
-  return rand() % 100 < 6;
-}
-
 /* ------------------------------ */
 /* ---- AFL Bindings ------------ */
 /* ------------------------------ */
 
 void *init(afl_state_t *afl, unsigned int seed) {
-  srand(seed);
   MutatorState *state = new MutatorState(seed);
+  state->set_afl(afl);
+  state->stats().set_name(reinterpret_cast<const char *>(afl->sync_id));
+
+  std::string error;
+  const char *tokens = getenv(kTokenFileEnv);
+  if (tokens && !state->mutator().dictionary().Load(tokens, error))
+    FATAL("lpm++: %s", error.c_str());
+
+  if (const char *share = getenv(kWireShareEnv)) {
+    char *end;
+    const double value = strtod(share, &end);
+    if (end == share || *end || !(value >= 0 && value <= 1))
+      FATAL("lpm++: %s must be between 0 and 1", kWireShareEnv);
+
+    state->set_wire_share(value);
+  }
+
+  return static_cast<void *>(state);
+}
+
+/**
+ * @brief Like init, but also loads the schema named by `LPMPP_DESCRIPTOR_SET`
+ * and `LPMPP_ROOT_MESSAGE`, for use with the overloads of fuzz, init_trim and
+ * post_process which take no message type
+ * 
+ */
+void *init_dynamic(afl_state_t *afl, unsigned int seed) {
+  std::string error;
+  std::unique_ptr<DynamicSchema> schema = DynamicSchema::FromEnv(error);
+  if (!schema)
+    FATAL("lpm++: %s", error.c_str());
+
+  MutatorState *state = static_cast<MutatorState *>(init(afl, seed));
+  state->set_schema(std::move(schema));
   return static_cast<void *>(state);
 }
 
@@ -111,81 +474,704 @@ void deinit(MutatorState *state) {
   delete state;
 }
 
+/**
+ * @brief Splices a field of an entry in the splice pool into `proto`, and
+ * stores the queue id of the entry in `donor`. Returns false if no entry 
+ * contains a field to splice.
+ * 
+ */
+bool Splice(MutatorState *state, google::protobuf::Message &proto, std::size_t max_size,
+  int32_t &donor) {
+  
+  SplicePool &pool = state->splice_pool();
+
+  const MutationTag &tag = state->mutator().SpliceOne(proto, max_size, 
+    [&](const google::protobuf::FieldDescriptor &field, uint64_t random) {
+      int count;
+      const uint32_t *entries = pool.Donors(field, count);
+      if (count == 0)
+        return static_cast<google::protobuf::Message *>(nullptr);
+
+      const uint32_t id = entries[random % count];
+      donor = pool.queue_id(id);
+      return state->donor_cache().Get(pool, id, proto);
+    });
+
+  return tag.valid();
+}
+
+/**
+ * @brief Collects the operands of the comparisons in the cmplog map of AFL++
+ * into `operands`. Routine operands are read up to their logged length, 
+ * instruction operands wider than 64 bits are skipped.
+ * 
+ */
+void HarvestCmpLog(const struct cmp_map &map, CmpOperands &operands) {
+  operands.Clear();
+
+  for (std::size_t k = 0; k < CMP_MAP_W && operands.size() < kMaxCmpOperands; k++) {
+    const struct cmp_header &header = map.headers[k];
+    if (!header.hits)
+      continue;
+
+    if (header.type == CMP_TYPE_RTN) {
+      const struct cmpfn_operands *log = reinterpret_cast<const struct cmpfn_operands *>(map.log[k]);
+      const unsigned hits = std::min<unsigned>(header.hits, CMP_MAP_RTN_H);
+
+      for (unsigned i = 0; i < hits; i++) {
+        // The high bit marks operands of string functions
+        const std::size_t size0 = std::min<std::size_t>(log[i].v0_len & 0x7f, sizeof(log[i].v0));
+        const std::size_t size1 = std::min<std::size_t>(log[i].v1_len & 0x7f, sizeof(log[i].v1));
+        operands.AddStrings(log[i].v0, size0, log[i].v1, size1);
+      }
+    } else {
+      const unsigned width = header.shape + 1;
+      if (width > 8 || (width & (width - 1)))
+        continue;
+
+      const unsigned hits = std::min<unsigned>(header.hits, CMP_MAP_H);
+      for (unsigned i = 0; i < hits; i++)
+        operands.AddIntegers(map.log[k][i].v0, map.log[k][i].v1, width);
+    }
+  }
+}
+
+/**
+ * @brief Sets a field of `proto` holding one side of a comparison logged by
+ * the cmplog binary to the other side. The operands are collected again at
+ * the first injection after AFL++ selects an entry, as the cmplog stage of
+ * the entry runs after queue_get. Returns false without `-c`, or if no field
+ * matched.
+ * 
+ */
+bool Inject(MutatorState *state, google::protobuf::Message &proto, std::size_t max_size) {
+  afl_state_t *afl = state->afl();
+  if (!afl || !afl->shm.cmp_map)
+    return false;
+
+  if (state->cmplog_stale()) {
+    HarvestCmpLog(*afl->shm.cmp_map, state->cmp_operands());
+    state->set_cmplog_stale(false);
+  }
+
+  return state->mutator().InjectOne(proto, max_size, state->cmp_operands()).valid();
+}
+
+/**
+ * @brief Weights deletions up while messages are bloated, called whenever
+ * the bloat detector recomputes its drift
+ * 
+ */
+void UpdateBloat(MutatorState *state) {
+  state->mutator().scheduler().Bias(OP_DELETE, state->bloat().DeleteBias());
+}
+
+/**
+ * @brief Replaces a leaf value of `buf`, a serialized `type`, without 
+ * parsing it, for wire_share of the replacements. Returns false if the
+ * input is not well-formed, has no leaf, or the mutant would not fit.
+ * 
+ */
+bool WireReplace(MutatorState *state, const google::protobuf::Descriptor &type, 
+  const uint8_t *buf, std::size_t buf_size, std::size_t max_size) {
+  
+  if (!state->mutator().Chance(state->wire_share()))
+    return false;
+
+  PhaseTimer wtimer(state->stats(), PHASE_MUTATE);
+  const uint64_t start = state->stats().clock();
+  WireIndex &index = state->wire_index();
+  if (!index.Build(buf, buf_size, type) || !state->ReplaceWire(index, max_size))
+    return false;
+
+  state->stats().record_op(OP_REPLACE, start);
+  state->stats().inc_customfuzz_wire();
+  state->stats().inc_op_chosen(OP_REPLACE);
+  return true;
+}
+
+/**
+ * @brief Records the mutant in the output buffer of `state`, produced by a
+ * crossover with the queue entry `donor` or -1, and returns its size
+ * 
+ */
+std::size_t FinishMutant(MutatorState *state, int32_t donor) {
+  state->description().Record(state->mutator().tag(), donor);
+  state->timing().Produced(state->bufsize());
+  if (state->bloat().Mutant(state->bufsize()))
+    UpdateBloat(state);
+
+  state->stats().end();
+  return state->bufsize();
+}
+
+/**
+ * @brief returns true if the mutant in the output buffer of `state` is the
+ * input `buf` itself or a recent mutant, and records it otherwise
+ * 
+ */
+bool Duplicate(MutatorState *state, const uint8_t *buf, std::size_t buf_size) {
+  const uint8_t *out = state->buf();
+  const std::size_t size = state->bufsize();
+
+  // The output buffer is null until the first mutant is serialized
+  if (size == buf_size && (size == 0 || memcmp(out, buf, size) == 0))
+    return true;
+
+  return !state->mutant_filter().Insert(HashBytes(out, size));
+}
+
+/**
+ * @brief Mutates the input in `buf` into `proto` and serializes the mutant
+ * into the output buffer of `state`. Sets `donor` to the queue entry of a 
+ * crossover, or -1. Returns false if `buf` does not parse.
+ * 
+ */
 template<Derived<google::protobuf::Message> T>
-std::size_t fuzz(MutatorState *state, unsigned char *buf, 
+bool MutateInput(MutatorState *state, T &proto, unsigned char *buf, std::size_t buf_size, 
+  unsigned char *add_buf, std::size_t add_buf_size, std::size_t max_size, int32_t &donor) {
+  
+  // Either merge in contents from another entry, inject a comparison 
+  // operand or mutate a single field, as chosen by the scheduler, so that 
+  // new queue entries can be credited to one operator. Without add_buf, 
+  // i.e. with splice_optout bound, a field is spliced from an entry in the
+  // splice pool. A share of the value replacements skip parsing and 
+  // serialization by rewriting the serialized input.
+  const MutationOp op = state->mutator().NextOp();
+  donor = -1;
+
+  if (op == OP_REPLACE && WireReplace(state, *proto.GetDescriptor(), buf, buf_size, max_size))
+    return true;
+
+  // Parse buf into proto
+  {
+    PhaseTimer ptimer(state->stats(), PHASE_PARSE);
+    if (!state->parse_cache().Parse(buf, buf_size, proto)) {
+      state->stats().inc_customfuzz_parsefail();
+      return false;
+    }
+  }
+
+  bool crossed = false;
+  bool injected = false;
+
+  if (op == OP_CROSSOVER && state->timing().AllowCrossover()) {
+    PhaseTimer ctimer(state->stats(), PHASE_CROSSOVER);
+    const uint64_t start = state->stats().clock();
+
+    if (add_buf) {
+      T &merge_proto = *static_cast<T *>(proto.New(&state->arena()));
+      if (merge_proto.ParseFromArray(add_buf, add_buf_size)) {
+        state->mutator().CrossOverOne(merge_proto, proto, max_size);
+        crossed = true;
+        // AFL++ records the queue entry it passes as add_buf
+        donor = state->afl()->splicing_with;
+      } else {
+        state->stats().inc_customfuzz_addbuf_parsefail();
+      }
+    } else {
+      crossed = Splice(state, proto, max_size, donor);
+    }
+
+    if (crossed) {
+      state->stats().record_op(OP_CROSSOVER, start);
+      state->stats().inc_op_chosen(OP_CROSSOVER);
+    } else {
+      donor = -1;
+    }
+  } else if (op == OP_INJECT) {
+    PhaseTimer itimer(state->stats(), PHASE_MUTATE);
+    const uint64_t start = state->stats().clock();
+    injected = Inject(state, proto, max_size);
+
+    if (injected) {
+      state->stats().record_op(OP_INJECT, start);
+      state->stats().inc_op_chosen(OP_INJECT);
+    }
+  }
+
+  if (!(crossed || injected) || proto.ByteSizeLong() > max_size) {
+    // A splice may have grown the message past max_size, shrink it again.
+    // The mutant is still credited to the splice or injection.
+    PhaseTimer mtimer(state->stats(), PHASE_MUTATE);
+    const MutationTag tag = state->mutator().tag();
+    Mutate(state, proto, max_size, crossed || injected ? OP_DELETE : op);
+    if (crossed || injected)
+      state->mutator().set_tag(tag);
+  }
+
+  {
+    PhaseTimer stimer(state->stats(), PHASE_SERIALIZE);
+    state->Serialize(proto);
+  }
+
+  return true;
+}
+
+/**
+ * @brief Mutates the input in `buf` into `proto`, an empty message on the
+ * arena of `state`
+ * 
+ */
+template<Derived<google::protobuf::Message> T>
+std::size_t FuzzMessage(MutatorState *state, T &proto, unsigned char *buf, 
   std::size_t buf_size, unsigned char **outbuf, unsigned char *add_buf, 
   std::size_t add_buf_size, std::size_t max_size) {
   
   google::protobuf::LogSilencer silencer;
-  T proto;
+  PhaseTimer timer(state->stats(), PHASE_FUZZ);
   
   state->stats().begin();
   state->stats().inc_customfuzz();
+  state->stats().add_customfuzz_addbuf_provided(add_buf_size > 0 ? 1 : 0);
+  state->queue_index().Fuzzed();
 
-  // Parse buf into proto
-  if (!proto.ParseFromArray(buf, buf_size)) {
-    *outbuf = NULL;
-    state->stats().inc_customfuzz_parsefail();
-    return 0;
-  }
+  // Keep mutants of slow entries small, and have AFL++ trim them again.
+  // Once messages bloat, mutants do not grow past the bloat threshold.
+  TimingModel &timing = state->timing();
+  max_size = timing.SizeBudget(buf_size, max_size);
+  max_size = state->bloat().SizeBudget(buf_size, max_size);
+  if (timing.Retrim() && state->afl() && state->afl()->queue_cur)
+    state->afl()->queue_cur->trim_done = 0;
 
-  // Mutate values
-  Mutate(state, proto, max_size);
+  // Mutate again rather than return the input itself or a recent mutant,
+  // which AFL++ would run for nothing. After kDedupRetries the duplicate
+  // is returned anyway. Every mutant is checked, so that the one returned 
+  // is recorded in the filter.
+  int32_t donor = -1;
+  for (int attempt = 0; ; attempt++) {
+    if (!MutateInput(state, proto, buf, buf_size, add_buf, add_buf_size, max_size, donor)) {
+      if (attempt > 0)
+        break;
 
-  // Optionally merge in contents from add_buf
-  state->stats().add_customfuzz_addbuf_provided(add_buf_size > 0 ? 1 : 0);
-  if (ShouldCrossover()) {
-    if (T merge_proto; merge_proto.ParseFromArray(add_buf, add_buf_size)) {
-      state->mutator().CrossOver(merge_proto, &proto, max_size);
-    } else {
-      state->stats().inc_customfuzz_addbuf_parsefail();
+      *outbuf = NULL;
+      return 0;
     }
-  }
 
-  // Convert protobuf to string 
-  std::string str(Serialize(proto));
+    if (!Duplicate(state, buf, buf_size))
+      break;
 
-  // Copy to state->mutator_out
-  state->Store((const uint8_t *) str.c_str(), str.length());
+    state->stats().inc_customfuzz_duplicate();
+    if (attempt == kDedupRetries)
+      break;
+  }
 
-  // Write mutator_out to out_buf
   *outbuf = state->buf();
-
-  state->stats().end();
-  return state->bufsize();
+  return FinishMutant(state, donor);
 }
 
 template<Derived<google::protobuf::Message> T>
-int init_trim(MutatorState *state, unsigned char *buf, std::size_t buf_size) {
+std::size_t fuzz(MutatorState *state, unsigned char *buf, 
+  std::size_t buf_size, unsigned char **outbuf, unsigned char *add_buf, 
+  std::size_t add_buf_size, std::size_t max_size) {
+  
+  ArenaScope scope(state->arena());
+  T &proto = *google::protobuf::Arena::CreateMessage<T>(&state->arena());
+  return FuzzMessage(state, proto, buf, buf_size, outbuf, add_buf, add_buf_size, max_size);
+}
+
+/**
+ * @brief fuzz for the schema loaded by init_dynamic
+ * 
+ */
+std::size_t fuzz(MutatorState *state, unsigned char *buf, 
+  std::size_t buf_size, unsigned char **outbuf, unsigned char *add_buf, 
+  std::size_t add_buf_size, std::size_t max_size) {
+  
+  ArenaScope scope(state->arena());
+  google::protobuf::Message &proto = *state->schema()->prototype().New(&state->arena());
+  return FuzzMessage(state, proto, buf, buf_size, outbuf, add_buf, add_buf_size, max_size);
+}
+
+/**
+ * @brief Starts trimming `buf`, parsed into `proto`
+ * 
+ */
+int InitTrim(MutatorState *state, std::unique_ptr<google::protobuf::Message> proto, 
+  unsigned char *buf, std::size_t buf_size) {
+  
   google::protobuf::LogSilencer silencer;
-  std::unique_ptr<google::protobuf::Message> proto = std::make_unique<T>();
 
   if (!proto->ParseFromArray(buf, buf_size))
     return 0;
 
   state->set_trimindex(0);
-  state->set_trimmer(std::make_unique<Trimmer>(std::move(proto)));
+  state->set_trimmer(std::make_unique<Trimmer>(std::move(proto), 
+                                               &state->trim_history()));
   return 1;
 }
 
+template<Derived<google::protobuf::Message> T>
+int init_trim(MutatorState *state, unsigned char *buf, std::size_t buf_size) {
+  return InitTrim(state, std::make_unique<T>(), buf, buf_size);
+}
+
+/**
+ * @brief init_trim for the schema loaded by init_dynamic
+ * 
+ */
+int init_trim(MutatorState *state, unsigned char *buf, std::size_t buf_size) {
+  std::unique_ptr<google::protobuf::Message> proto(state->schema()->prototype().New());
+  return InitTrim(state, std::move(proto), buf, buf_size);
+}
+
 std::size_t trim(MutatorState *state, unsigned char **outbuf) {
+  PhaseTimer timer(state->stats(), PHASE_TRIM);
   state->trimmer()->TrimOne();
   return state->trimmer()->Serialize(outbuf);
 }
 
 int post_trim(MutatorState *state, unsigned char success) {
+  PhaseTimer timer(state->stats(), PHASE_POST_TRIM);
+
   if (!success)
     state->trimmer()->Revert();
   
   return state->trimmer()->done() == 0 ? 1 : 0;
 }
 
+/**
+ * @brief Credits the operator of the last mutant with a new queue entry. 
+ * Only entries found during the custom mutator stage of this instance are
+ * credited: synced entries have no `filename_orig`, and those found by the
+ * stages of AFL++, including havoc stacked with havoc_mutation, were not
+ * produced by fuzz.
+ * 
+ */
+void CreditEntry(MutatorState *state, const uint8_t *filename_orig) {
+  afl_state_t *afl = state->afl();
+  if (!filename_orig || !afl || !afl->current_custom_fuzz || 
+      afl->current_custom_fuzz->data != state)
+    return;
+
+  const MutationTag &tag = state->mutator().tag();
+  if (tag.valid())
+    state->stats().inc_op_yields(tag.op);
+
+  state->mutator().Credit();
+}
+
+/**
+ * @brief Adds the tokens AFL++ loaded with `-x` and those it extracted 
+ * itself to the dictionary. AFL++ loads them after init and extracts more
+ * over time, so their number is checked whenever an entry is selected. 
+ * Once it holds MAX_AUTO_EXTRAS automatic tokens it replaces them in place
+ * and their number stays the same, so they are added again every 
+ * kAutoExtrasResync selections.
+ * 
+ */
+void SyncDictionary(MutatorState *state) {
+  afl_state_t *afl = state->afl();
+  if (!afl)
+    return;
+
+  const bool replacing = afl->a_extras_cnt >= MAX_AUTO_EXTRAS && 
+                         state->age_extras() >= kAutoExtrasResync;
+
+  if (!replacing && afl->extras_cnt == state->extras_synced() && 
+      afl->a_extras_cnt == state->auto_extras_synced())
+    return;
+
+  Dictionary &dictionary = state->mutator().dictionary();
+
+  for (uint32_t i = 0; i < afl->extras_cnt; i++)
+    dictionary.Add(afl->extras[i].data, afl->extras[i].len);
+
+  // Automatic tokens are replaced as AFL++ ranks them, add them all again
+  for (uint32_t i = 0; i < afl->a_extras_cnt; i++)
+    dictionary.Add(afl->a_extras[i].data, afl->a_extras[i].len);
+
+  state->set_extras_synced(afl->extras_cnt, afl->a_extras_cnt);
+}
+
+/**
+ * @brief Parses the new entry in `filename_new` into `proto` and indexes 
+ * it in a single pass over its fields: its structure for queue_get, the 
+ * fields it contains for the splice pool and the field heatmap, and the 
+ * tokens in its string and bytes values for the dictionary
+ * 
+ */
+void IndexEntry(MutatorState *state, google::protobuf::Message &proto, 
+  const uint8_t *filename_new) {
+  
+  google::protobuf::LogSilencer silencer;
+  const uint64_t entry = HashName(filename_new);
+
+  // An entry that cannot be read is not indexed, queue_get tries again
+  // when it is picked. AFL++ keeps no empty entries.
+  MappedFile file;
+  if (!file.Open(reinterpret_cast<const char *>(filename_new)))
+    return;
+
+  if (state->bloat().Entry(file.size()))
+    UpdateBloat(state);
+
+  if (!proto.ParseFromArray(file.data(), file.size())) {
+    state->queue_index().Add(entry, kUnparseable);
+    return;
+  }
+
+  SplicePool &pool = state->splice_pool();
+  FieldHeatmap &heatmap = state->mutator().heatmap();
+  Dictionary &dictionary = state->mutator().dictionary();
+  const uint32_t id = pool.Add(filename_new);
+  std::string scratch;
+
+  const uint64_t structure = WalkStructure(proto, 
+    [&](const google::protobuf::Message &msg, const FieldTable &table, const FieldEntry &field, 
+        uint32_t depth) {
+      pool.Present(id, table, field, depth);
+      heatmap.Present(id, table, field);
+
+      if (field.field->cpp_type() != google::protobuf::FieldDescriptor::CppType::CPPTYPE_STRING)
+        return;
+
+      const google::protobuf::Reflection &reflection = *msg.GetReflection();
+      if (!field.repeated) {
+        dictionary.Learn(table, field, reflection.GetStringReference(msg, field.field, &scratch));
+        return;
+      }
+
+      const int size = reflection.FieldSize(msg, field.field);
+      for (int i = 0; i < size; i++) {
+        dictionary.Learn(table, field, 
+          reflection.GetRepeatedStringReference(msg, field.field, i, &scratch));
+      }
+    });
+
+  state->queue_index().Add(entry, structure);
+}
+
+template<Derived<google::protobuf::Message> T>
+uint8_t queue_new_entry(MutatorState *state, const uint8_t *filename_new, 
+  const uint8_t *filename_orig) {
+  
+  CreditEntry(state, filename_orig);
+
+  ArenaScope scope(state->arena());
+  T &proto = *google::protobuf::Arena::CreateMessage<T>(&state->arena());
+  IndexEntry(state, proto, filename_new);
+  return 0;
+}
+
+/**
+ * @brief queue_new_entry for the schema loaded by init_dynamic. Without a
+ * schema the entry is only credited.
+ * 
+ */
+uint8_t queue_new_entry(MutatorState *state, const uint8_t *filename_new, 
+  const uint8_t *filename_orig) {
+  
+  CreditEntry(state, filename_orig);
+
+  if (state->schema()) {
+    ArenaScope scope(state->arena());
+    google::protobuf::Message &proto = *state->schema()->prototype().New(&state->arena());
+    IndexEntry(state, proto, filename_new);
+  }
+
+  return 0;
+}
+
+/**
+ * @brief Decides whether AFL++ should fuzz the queue entry in `filename`,
+ * parsing it into `proto` the first time it is seen
+ * 
+ */
+uint8_t QueueGet(MutatorState *state, google::protobuf::Message &proto, 
+  const uint8_t *filename) {
+  
+  QueueIndex &index = state->queue_index();
+  const uint64_t entry = HashName(filename);
+  uint64_t structure = kUnparseable;
+
+  // Entries that were not passed to queue_new_entry, e.g. the seeds, are
+  // indexed when they are first picked
+  if (!index.Find(entry, structure)) {
+    IndexEntry(state, proto, filename);
+    index.Find(entry, structure);
+  }
+
+  if (structure == kUnparseable) {
+    state->stats().inc_queueget_parsefail();
+    return 0;
+  }
+
+  if (!index.Select(entry, structure)) {
+    state->stats().inc_queueget_duplicate();
+    return 0;
+  }
+
+  SyncDictionary(state);
+  state->timing().Select(structure);
+
+  // Bloated entries are trimmed again once, before they are fuzzed
+  afl_state_t *afl = state->afl();
+  if (afl && afl->queue_cur && state->bloat().Bloated(afl->queue_cur->len) &&
+      state->bloat().Retrim(entry))
+    afl->queue_cur->trim_done = 0;
+
+  // The cmplog stage of this entry refills the map
+  state->set_cmplog_stale(true);
+  return 1;
+}
+
+/**
+ * @brief Skips queue entries which do not parse as `T`, and entries with the
+ * same structure as an entry that was already fuzzed heavily
+ * 
+ */
+template<Derived<google::protobuf::Message> T>
+uint8_t queue_get(MutatorState *state, const uint8_t *filename) {
+  ArenaScope scope(state->arena());
+  T &proto = *google::protobuf::Arena::CreateMessage<T>(&state->arena());
+  return QueueGet(state, proto, filename);
+}
+
+/**
+ * @brief queue_get for the schema loaded by init_dynamic
+ * 
+ */
+uint8_t queue_get(MutatorState *state, const uint8_t *filename) {
+  ArenaScope scope(state->arena());
+  google::protobuf::Message &proto = *state->schema()->prototype().New(&state->arena());
+  return QueueGet(state, proto, filename);
+}
+
+/**
+ * @brief Applies a single scheduled mutation to `buf`, parsed into `proto`.
+ * Inputs that do not parse, e.g. after byte-level havoc, are returned as
+ * they are, as are inputs whose mutant does not fit in `max_size`.
+ * 
+ */
+template<Derived<google::protobuf::Message> T>
+std::size_t HavocMutation(MutatorState *state, T &proto, unsigned char *buf, 
+  std::size_t buf_size, unsigned char **out_buf, std::size_t max_size) {
+  
+  google::protobuf::LogSilencer silencer;
+
+  if (!proto.ParseFromArray(buf, buf_size)) {
+    *out_buf = buf;
+    return buf_size;
+  }
+
+  // AFL++ does not check the size returned by havoc_mutation, keep the 
+  // input if the mutant could not be shrunk below max_size
+  Mutate(state, proto, max_size, state->mutator().NextOp());
+  if (proto.ByteSizeLong() > max_size) {
+    *out_buf = buf;
+    return buf_size;
+  }
+
+  state->Serialize(proto);
+  *out_buf = state->buf();
+  return state->bufsize();
+}
+
+/**
+ * @brief A structure-aware mutation for AFL++ to stack with its havoc 
+ * mutations
+ * 
+ */
+template<Derived<google::protobuf::Message> T>
+std::size_t havoc_mutation(MutatorState *state, unsigned char *buf, std::size_t buf_size, 
+  unsigned char **out_buf, std::size_t max_size) {
+  
+  ArenaScope scope(state->arena());
+  T &proto = *google::protobuf::Arena::CreateMessage<T>(&state->arena());
+  return HavocMutation(state, proto, buf, buf_size, out_buf, max_size);
+}
+
+/**
+ * @brief havoc_mutation for the schema loaded by init_dynamic
+ * 
+ */
+std::size_t havoc_mutation(MutatorState *state, unsigned char *buf, std::size_t buf_size, 
+  unsigned char **out_buf, std::size_t max_size) {
+  
+  ArenaScope scope(state->arena());
+  google::protobuf::Message &proto = *state->schema()->prototype().New(&state->arena());
+  return HavocMutation(state, proto, buf, buf_size, out_buf, max_size);
+}
+
+/**
+ * @brief Percentage of havoc mutations that AFL++ delegates to 
+ * havoc_mutation
+ * 
+ */
+uint8_t havoc_mutation_probability(MutatorState *state) {
+  UNUSED(state);
+  return kHavocProbability;
+}
+
+/**
+ * @brief Binding this hook stops AFL++ from passing add_buf to fuzz, which
+ * then splices from its own pool of parsed entries
+ * 
+ */
+void splice_optout(MutatorState *state) {
+  UNUSED(state);
+}
+
+/**
+ * @brief Called by AFL++ after each execution of the target, times the
+ * mutants returned by fuzz
+ * 
+ */
+void post_run(MutatorState *state) {
+  state->timing().Ran();
+}
+
+/**
+ * @brief Describes the last mutant for the name of a new queue entry or
+ * crash, see MutantDescription
+ * 
+ */
+const char * describe(MutatorState *state, std::size_t max_description_len) {
+  return state->description().Format(max_description_len);
+}
+
+/**
+ * @brief Describes the last mutant for the introspection log of AFL++
+ * 
+ */
+const char * introspection(MutatorState *state) {
+  return state->description().Format(kDescriptionSize - 1);
+}
+
 std::size_t post_process(MutatorState *state, unsigned char *buf, 
   std::size_t buf_size, unsigned char **outbuf) {
   
-  // TODO: end stats here
+  PhaseTimer timer(state->stats(), PHASE_POST_PROCESS);
   *outbuf = buf;
   return buf_size;
 }
 
+/**
+ * @brief Parses `buf` and converts it to the input format of the target 
+ * with `encode`, a callable taking `const T &` and the output `std::string &`
+ * 
+ */
+template<Derived<google::protobuf::Message> T, typename Encoder>
+std::size_t post_process(MutatorState *state, unsigned char *buf, 
+  std::size_t buf_size, unsigned char **outbuf, Encoder encode) {
+  
+  google::protobuf::LogSilencer silencer;
+  PhaseTimer timer(state->stats(), PHASE_POST_PROCESS);
+  ArenaScope scope(state->arena());
+  T &proto = *google::protobuf::Arena::CreateMessage<T>(&state->arena());
+
+  if (!proto.ParseFromArray(buf, buf_size)) {
+    *outbuf = nullptr;
+    return 0;
+  }
+
+  std::string &out = state->encoded();
+  out.clear();
+  encode(proto, out);
+
+  *outbuf = reinterpret_cast<unsigned char *>(out.data());
+  return out.size();
+}
+
 };
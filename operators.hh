@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+
+namespace google::protobuf {
+class FieldDescriptor;
+}
+
+namespace lpmpp {
+
+enum MutationOp {
+  OP_ADD,
+  OP_DELETE,
+  OP_REPLACE,
+  OP_COPY,
+  OP_CLONE,
+  OP_CROSSOVER,
+  OP_INJECT,
+  NUM_OPS,
+};
+
+const char * const MutationOpDesc[] = {
+  "add",
+  "delete",
+  "replace",
+  "copy",
+  "clone",
+  "crossover",
+  "inject",
+};
+
+
+static const int kMaxFieldPath = 8;
+
+
+/**
+ * @brief The fields leading from the root message to the message containing
+ * a field, truncated after kMaxFieldPath fields
+ * 
+ */
+struct FieldPath {
+  const google::protobuf::FieldDescriptor *fields[kMaxFieldPath];
+  int depth = 0;
+};
+
+
+/**
+ * @brief Describes how the last mutant was produced
+ * 
+ */
+struct MutationTag {
+  MutationOp op = NUM_OPS;
+  const google::protobuf::FieldDescriptor *field = nullptr;
+  FieldPath path;
+
+  bool valid() const {
+    return op != NUM_OPS;
+  }
+};
+
+}
@@ -0,0 +1,64 @@
+#include <cstdlib>
+#include <cstring>
+
+#include "queue.hh"
+#include "utils.hh"
+
+using namespace google::protobuf;
+
+namespace lpmpp {
+
+/* -------------------------------------- */
+/* --- Structural hashing --------------- */
+/* -------------------------------------- */
+
+uint64_t StructuralHash(const Message &msg) {
+  return WalkStructure(msg, [](const Message &, const FieldTable &, const FieldEntry &, uint32_t) {});
+}
+
+
+uint64_t HashName(const uint8_t *name) {
+  uint64_t hash = kQueueHashOffset;
+  for (; *name; name++) {
+    hash = HashMix(hash, *name);
+  }
+  return hash == 0 ? 1 : hash;
+}
+
+
+/* -------------------------------------- */
+/* --- SplicePool method definitions ---- */
+/* -------------------------------------- */
+
+int32_t SplicePool::QueueId(const std::string &path) {
+  // AFL++ names queue entries id:000017,...
+  const std::size_t base = path.rfind('/');
+  const char *name = path.c_str() + (base == std::string::npos ? 0 : base + 1);
+  if (strncmp(name, "id:", 3) != 0)
+    return -1;
+
+  return std::strtol(name + 3, nullptr, 10);
+}
+
+/* -------------------------------------- */
+/* --- DonorCache method definitions ---- */
+/* -------------------------------------- */
+
+Message * DonorCache::Get(const SplicePool &pool, uint32_t id, const Message &prototype) {
+  Slot &slot = slots[id % kDonorCacheSize];
+
+  if (slot.id == id && slot.msg && slot.msg->GetDescriptor() == prototype.GetDescriptor())
+    return slot.valid ? slot.msg.get() : nullptr;
+
+  if (!slot.msg || slot.msg->GetDescriptor() != prototype.GetDescriptor())
+    slot.msg.reset(prototype.New());
+
+  MappedFile file;
+  file.Open(pool.name(id).c_str());
+
+  slot.id = id;
+  slot.valid = slot.msg->ParseFromArray(file.data(), file.size());
+  return slot.valid ? slot.msg.get() : nullptr;
+}
+
+}
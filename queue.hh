@@ -0,0 +1,400 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <google/protobuf/message.h>
+
+#include "fieldtable.hh"
+
+namespace lpmpp {
+
+// Structure hash of entries that do not parse
+static const uint64_t kUnparseable = 0;
+// Calls to fuzz after which other entries with the same structure are skipped
+static const uint32_t kQueueSaturation = 1 << 15;
+// Most recent entries kept per field in the splice pool
+static const int kSpliceDonors = 8;
+// Parsed donors kept by the donor cache
+static const int kDonorCacheSize = 8;
+
+static const uint64_t kQueueHashOffset = 0xcbf29ce484222325ULL;
+static const uint64_t kQueueHashPrime = 0x100000001b3ULL;
+
+
+static inline uint64_t HashMix(uint64_t hash, uint64_t value) {
+  return (hash ^ value) * kQueueHashPrime;
+}
+
+
+/**
+ * @brief Walks the fields set in `root` in a single pass, calling 
+ * `visit(msg, table, entry, depth)` for each, and returns the hash of its 
+ * shape.
+ * See StructuralHash.
+ * 
+ */
+template<typename Visit>
+uint64_t WalkStructure(const google::protobuf::Message &root, Visit visit) {
+  struct Frame {
+    const google::protobuf::Message *msg;
+    uint32_t depth;
+  };
+
+  uint64_t hash = kQueueHashOffset;
+  std::vector<Frame> stack = {{&root, 0}};
+
+  while (!stack.empty()) {
+    const Frame frame = stack.back();
+    stack.pop_back();
+
+    const FieldTable &table = GetFieldTable(*frame.msg);
+    const google::protobuf::Reflection &reflection = *frame.msg->GetReflection();
+
+    // Frames are popped in a fixed order, so the depth and the type tell
+    // where each message is in the tree
+    hash = HashMix(hash, (static_cast<uint64_t>(frame.depth) << 32) | table.id);
+
+    for (const FieldEntry &entry : table.fields) {
+      if (!IsSet(*frame.msg, reflection, entry))
+        continue;
+
+      visit(*frame.msg, table, entry, frame.depth);
+      hash = HashMix(hash, entry.field->number());
+
+      if (entry.repeated) {
+        const int size = reflection.FieldSize(*frame.msg, entry.field);
+        hash = HashMix(hash, std::bit_width(static_cast<unsigned>(size)));
+
+        if (entry.message) {
+          for (int i = size - 1; i >= 0; i--)
+            stack.push_back({&reflection.GetRepeatedMessage(*frame.msg, entry.field, i), frame.depth + 1});
+        }
+      } else if (entry.message) {
+        stack.push_back({&reflection.GetMessage(*frame.msg, entry.field), frame.depth + 1});
+      }
+    }
+  }
+
+  return hash == kUnparseable ? 1 : hash;
+}
+
+
+/**
+ * @brief Hash of the shape of `msg`: the numbers of the fields set at every
+ * depth and the rough size of repeated fields, but no values. Never returns
+ * kUnparseable.
+ * 
+ */
+uint64_t StructuralHash(const google::protobuf::Message &msg);
+
+/**
+ * @brief FNV-1a hash of a NUL-terminated string
+ * 
+ */
+uint64_t HashName(const uint8_t *name);
+
+
+/**
+ * @brief Open addressing map from nonzero 64-bit hashes to small values,
+ * kept at most half full
+ * 
+ */
+template<typename V>
+class HashIndex {
+private:
+  struct Slot {
+    uint64_t key;
+    V value;
+  };
+
+  std::vector<Slot> slots;
+  std::size_t used = 0;
+
+public:
+  V * Find(uint64_t key) {
+    if (slots.empty())
+      return nullptr;
+
+    const std::size_t mask = slots.size() - 1;
+    for (std::size_t i = Start(key, mask); slots[i].key != 0; i = (i + 1) & mask) {
+      if (slots[i].key == key)
+        return &slots[i].value;
+    }
+
+    return nullptr;
+  }
+
+  const V * Find(uint64_t key) const {
+    return const_cast<HashIndex *>(this)->Find(key);
+  }
+
+  /**
+   * @brief returns the value of `key`, inserting `value` if it is missing.
+   * Pointers returned by Find and Insert are invalidated by an insertion.
+   * 
+   */
+  V & Insert(uint64_t key, const V &value) {
+    if (V *found = Find(key))
+      return *found;
+
+    if (2 * (used + 1) > slots.size())
+      Grow();
+
+    const std::size_t mask = slots.size() - 1;
+    std::size_t i = Start(key, mask);
+    while (slots[i].key != 0)
+      i = (i + 1) & mask;
+
+    slots[i] = Slot{key, value};
+    used++;
+    return slots[i].value;
+  }
+
+  std::size_t size() const {
+    return used;
+  }
+
+  void clear() {
+    slots.clear();
+    used = 0;
+  }
+
+private:
+  static std::size_t Start(uint64_t key, std::size_t mask) {
+    // Keys are hashes already, fold the high bits into the index
+    return (key ^ (key >> 32)) & mask;
+  }
+
+  void Grow() {
+    std::vector<Slot> old(std::max<std::size_t>(16, 2 * slots.size()));
+    old.swap(slots);
+    used = 0;
+
+    for (const Slot &slot : old) {
+      if (slot.key != 0)
+        Insert(slot.key, slot.value);
+    }
+  }
+};
+
+
+/**
+ * @brief Verdicts of afl_custom_queue_get. Every entry is parsed once,
+ * entries which do not parse are always skipped. Entries are grouped by
+ * structure: the first entry of a structure is always fuzzed, the others
+ * only until the structure has been fuzzed kQueueSaturation times.
+ * 
+ */
+class QueueIndex {
+private:
+  struct Structure {
+    uint64_t owner;
+    uint32_t fuzzed;
+  };
+
+  // Structure hash by entry name hash
+  HashIndex<uint64_t> entries;
+  HashIndex<Structure> structures;
+  // Structure of the entry being fuzzed, the pointer is refreshed when 
+  // an insertion moves it
+  uint64_t current_key = kUnparseable;
+  Structure *current = nullptr;
+
+public:
+  /**
+   * @brief looks up the structure of an entry seen before
+   * 
+   */
+  bool Find(uint64_t entry, uint64_t &structure) {
+    const uint64_t *found = entries.Find(entry);
+    if (found)
+      structure = *found;
+    return found != nullptr;
+  }
+
+  void Add(uint64_t entry, uint64_t structure) {
+    entries.Insert(entry, structure);
+    if (structure != kUnparseable)
+      structures.Insert(structure, Structure{entry, 0});
+
+    if (current)
+      current = structures.Find(current_key);
+  }
+
+  /**
+   * @brief returns true if `entry` should be fuzzed, and if so makes it the
+   * current entry
+   * 
+   */
+  bool Select(uint64_t entry, uint64_t structure) {
+    current = nullptr;
+    if (structure == kUnparseable)
+      return false;
+
+    Structure *found = structures.Find(structure);
+    if (found->owner != entry && found->fuzzed >= kQueueSaturation)
+      return false;
+
+    current_key = structure;
+    current = found;
+    return true;
+  }
+
+  /**
+   * @brief Counts a call to fuzz for the current entry
+   * 
+   */
+  void Fuzzed() {
+    if (current)
+      current->fuzzed++;
+  }
+
+  std::size_t size() const {
+    return entries.size();
+  }
+};
+
+
+
+/**
+ * @brief Queue entries indexed by the fields they contain, so that a donor
+ * for a field can be found without parsing the queue. Each field keeps the
+ * kSpliceDonors most recent entries containing it.
+ * 
+ */
+class SplicePool {
+private:
+  struct FieldDonors {
+    // Last entry recorded, so that repeated fields count once per entry
+    uint32_t stamp = UINT32_MAX;
+    uint32_t seen = 0;
+    uint32_t entries[kSpliceDonors];
+  };
+
+  std::vector<std::string> names;
+  std::vector<int32_t> queue_ids;
+  std::vector<uint32_t> depths;
+  // Indexed by FieldTable::id, then FieldDescriptor::index()
+  std::vector<std::vector<FieldDonors>> fields;
+
+public:
+  /**
+   * @brief Adds the entry in `name`, returns its number
+   * 
+   */
+  uint32_t Add(const uint8_t *name) {
+    names.emplace_back(reinterpret_cast<const char *>(name));
+    queue_ids.push_back(QueueId(names.back()));
+    depths.push_back(0);
+    return names.size() - 1;
+  }
+
+  /**
+   * @brief Records that `entry` is set in the entry numbered `id`, at `depth`
+   * 
+   */
+  void Present(uint32_t id, const FieldTable &table, const FieldEntry &entry, uint32_t depth) {
+    if (fields.size() <= static_cast<std::size_t>(table.id))
+      fields.resize(table.id + 1);
+
+    std::vector<FieldDonors> &donors = fields[table.id];
+    if (donors.empty())
+      donors.resize(table.fields.size());
+
+    FieldDonors &d = donors[entry.index];
+    if (d.stamp != id) {
+      d.stamp = id;
+      d.entries[d.seen++ % kSpliceDonors] = id;
+    }
+
+    depths[id] = std::max(depths[id], depth + 1);
+  }
+
+  /**
+   * @brief returns the recent entries containing `field`, and their number
+   * in `count`
+   * 
+   */
+  const uint32_t * Donors(const google::protobuf::FieldDescriptor &field, int &count) const {
+    const FieldDonors *d = find(field);
+    count = d ? std::min<uint32_t>(d->seen, kSpliceDonors) : 0;
+    return d ? d->entries : nullptr;
+  }
+
+  /**
+   * @brief returns the number of entries which contained `field`
+   * 
+   */
+  uint32_t Seen(const google::protobuf::FieldDescriptor &field) const {
+    const FieldDonors *d = find(field);
+    return d ? d->seen : 0;
+  }
+
+  const std::string & name(uint32_t id) const {
+    return names[id];
+  }
+
+  /**
+   * @brief returns the AFL++ queue id of the entry numbered `id`, taken from
+   * its file name, or -1
+   * 
+   */
+  int32_t queue_id(uint32_t id) const {
+    return queue_ids[id];
+  }
+
+  /**
+   * @brief returns the nesting depth of the entry numbered `id`
+   * 
+   */
+  uint32_t depth(uint32_t id) const {
+    return depths[id];
+  }
+
+  std::size_t size() const {
+    return names.size();
+  }
+
+private:
+  static int32_t QueueId(const std::string &path);
+
+  const FieldDonors * find(const google::protobuf::FieldDescriptor &field) const {
+    const std::size_t id = GetFieldTable(*field.containing_type()).id;
+    if (fields.size() <= id || fields[id].empty())
+      return nullptr;
+    return &fields[id][field.index()];
+  }
+};
+
+
+
+/**
+ * @brief Splice pool entries parsed on demand. Direct mapped by entry 
+ * number, entries that do not parse are cached as such.
+ * 
+ */
+class DonorCache {
+private:
+  struct Slot {
+    uint32_t id = UINT32_MAX;
+    std::unique_ptr<google::protobuf::Message> msg;
+    bool valid = false;
+  };
+
+  Slot slots[kDonorCacheSize];
+
+public:
+  /**
+   * @brief returns the entry numbered `id` in `pool`, parsed as the type of
+   * `prototype`, or nullptr if it does not parse
+   * 
+   */
+  google::protobuf::Message * Get(const SplicePool &pool, uint32_t id, 
+                                  const google::protobuf::Message &prototype);
+};
+
+}
@@ -0,0 +1,125 @@
+#include <algorithm>
+#include <numeric>
+
+#include "scheduler.hh"
+
+namespace lpmpp {
+
+/* -------------------------------------- */
+/* --- AliasTable method definitions ---- */
+/* -------------------------------------- */
+
+void AliasTable::Build(const std::vector<double> &weights) {
+  const std::size_t n = weights.size();
+  const double total = std::accumulate(weights.begin(), weights.end(), 0.0);
+
+  prob.assign(n, 1.0);
+  alias.resize(n);
+
+  std::vector<double> scaled(n);
+  std::vector<uint32_t> small;
+  std::vector<uint32_t> large;
+
+  for (std::size_t i = 0; i < n; i++) {
+    alias[i] = i;
+    scaled[i] = weights[i] * n / total;
+    (scaled[i] < 1.0 ? small : large).push_back(i);
+  }
+
+  // Pair each underfull bucket with an overfull one
+
+  while (!small.empty() && !large.empty()) {
+    const uint32_t s = small.back();
+    const uint32_t l = large.back();
+    small.pop_back();
+
+    prob[s] = scaled[s];
+    alias[s] = l;
+    scaled[l] -= 1.0 - scaled[s];
+
+    if (scaled[l] < 1.0) {
+      large.pop_back();
+      small.push_back(l);
+    }
+  }
+
+  // Remaining buckets are full up to rounding errors
+  for (uint32_t i : small) prob[i] = 1.0;
+  for (uint32_t i : large) prob[i] = 1.0;
+}
+
+/* -------------------------------------- */
+/* --- Scheduler method definitions ----- */
+/* -------------------------------------- */
+
+Scheduler::Scheduler() {
+  for (int op = 0; op < NUM_OPS; op++) {
+    base[op] = (1.0 - kCrossoverShare - kInjectShare) / (NUM_OPS - 2);
+    bias[op] = 1.0;
+  }
+
+  base[OP_CROSSOVER] = kCrossoverShare;
+  base[OP_INJECT] = kInjectShare;
+
+  weights.assign(base, base + NUM_OPS);
+  SetProbabilities();
+}
+
+
+void Scheduler::SetProbabilities() {
+  std::vector<double> biased(NUM_OPS);
+  for (int op = 0; op < NUM_OPS; op++) {
+    biased[op] = weights[op] * bias[op];
+  }
+
+  const double total = std::accumulate(biased.begin(), biased.end(), 0.0);
+  for (int op = 0; op < NUM_OPS; op++) {
+    probs[op] = biased[op] / total;
+  }
+
+  table.Build(biased);
+}
+
+
+void Scheduler::Bias(MutationOp op, double factor) {
+  if (bias[op] == factor)
+    return;
+
+  bias[op] = factor;
+  SetProbabilities();
+}
+
+
+void Scheduler::Update() {
+  double chosen = 0;
+  double yields = 0;
+  for (int op = 0; op < NUM_OPS; op++) {
+    chosen += ops[op].chosen;
+    yields += ops[op].yields;
+  }
+
+  // Without any yields keep the current distribution
+
+  if (yields > 0) {
+    const double mean = yields / chosen;
+    double total = 0;
+
+    for (int op = 0; op < NUM_OPS; op++) {
+      const double rate = (ops[op].yields + kSchedulerPrior * mean) / (ops[op].chosen + kSchedulerPrior);
+      weights[op] = base[op] * rate / mean;
+      total += weights[op];
+    }
+
+    for (int op = 0; op < NUM_OPS; op++) {
+      weights[op] = std::max(weights[op] / total, kSchedulerFloor);
+    }
+
+    SetProbabilities();
+  }
+
+  for (int op = 0; op < NUM_OPS; op++) {
+    ops[op].Decay(kSchedulerDecay);
+  }
+}
+
+}
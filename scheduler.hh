@@ -0,0 +1,152 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "libprotobuf-mutator/src/mutator.h"
+#include "operators.hh"
+
+namespace lpmpp {
+
+// Selections between updates of the operator probabilities
+static const uint64_t kSchedulerEpoch = 4096;
+// Weight of past epochs, older selections and yields fade out
+static const double kSchedulerDecay = 0.5;
+// Every operator keeps at least this share of the selections
+static const double kSchedulerFloor = 0.02;
+// Initial shares of crossover and of cmplog operand injection, the 
+// remainder is split between the others
+static const double kCrossoverShare = 0.06;
+static const double kInjectShare = 0.06;
+// Pseudo-counts, a new arm starts with the mean yield rate
+static const double kSchedulerPrior = 16.0;
+
+
+/**
+ * @brief returns a uniformly distributed value in [0, 1)
+ * 
+ */
+inline double Uniform(protobuf_mutator::RandomEngine &random) {
+  return static_cast<double>(random() - random.min()) / 
+         (static_cast<double>(random.max() - random.min()) + 1);
+}
+
+
+/**
+ * @brief Samples from a discrete distribution in constant time, using 
+ * Vose's alias method
+ * 
+ */
+class AliasTable {
+private:
+  std::vector<double> prob;
+  std::vector<uint32_t> alias;
+
+public:
+  /**
+   * @brief Builds the table from non-negative weights, not all zero
+   * 
+   */
+  void Build(const std::vector<double> &weights);
+
+  std::size_t Sample(protobuf_mutator::RandomEngine &random) const {
+    const std::size_t i = random() % prob.size();
+    return Uniform(random) < prob[i] ? i : alias[i];
+  }
+
+  std::size_t size() const {
+    return prob.size();
+  }
+};
+
+
+/**
+ * @brief Decayed number of selections and yields of one arm
+ * 
+ */
+struct Arm {
+  double chosen = 0;
+  double yields = 0;
+
+  void Decay(double factor) {
+    chosen *= factor;
+    yields *= factor;
+  }
+};
+
+
+/**
+ * @brief Multi-armed bandit over mutation operators. Operators are drawn 
+ * from an alias table which is rebuilt once per epoch from the decayed 
+ * yield rate of each operator, so that executions go to the operators which
+ * currently find new coverage.
+ * 
+ */
+class Scheduler {
+private:
+  Arm ops[NUM_OPS];
+  double base[NUM_OPS];
+  // Multiplies the learned weight of each operator, see Bias
+  double bias[NUM_OPS];
+  std::vector<double> weights;
+  double probs[NUM_OPS];
+  AliasTable table;
+  uint64_t nselections = 0;
+
+public:
+  Scheduler();
+
+  /**
+   * @brief Draws the next mutation operator
+   * 
+   */
+  MutationOp Next(protobuf_mutator::RandomEngine &random) {
+    if (++nselections % kSchedulerEpoch == 0)
+      Update();
+
+    return static_cast<MutationOp>(table.Sample(random));
+  }
+
+  /**
+   * @brief Records that `tag` was applied
+   * 
+   */
+  void Chosen(const MutationTag &tag) {
+    ops[tag.op].chosen++;
+  }
+
+  /**
+   * @brief Records that the mutant of `tag` produced a new queue entry
+   * 
+   */
+  void Reward(const MutationTag &tag) {
+    ops[tag.op].yields++;
+  }
+
+  /**
+   * @brief returns the current probability of selecting `op`
+   * 
+   */
+  double Probability(MutationOp op) const {
+    return probs[op];
+  }
+
+  /**
+   * @brief Multiplies the learned weight of `op` by `factor`, 1 to undo,
+   * e.g. to favour deletions while messages bloat
+   * 
+   */
+  void Bias(MutationOp op, double factor);
+
+  /**
+   * @brief Recomputes the operator probabilities and decays the history
+   * 
+   */
+  void Update();
+
+private:
+  void SetProbabilities();
+};
+
+}
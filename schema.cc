@@ -0,0 +1,139 @@
+#include <cstdlib>
+#include <climits>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/wire_format_lite.h>
+
+#include "fieldtable.hh"
+#include "schema.hh"
+
+using namespace google::protobuf;
+using google::protobuf::internal::WireFormatLite;
+
+namespace lpmpp {
+
+/* -------------------------------------- */
+/* --- DynamicSchema method definitions - */
+/* -------------------------------------- */
+
+static const uint64_t kFNVOffset = 0xcbf29ce484222325ULL;
+static const uint64_t kFNVPrime = 0x100000001b3ULL;
+
+// FileDescriptorSet.file
+static const int kFileFieldNumber = 1;
+
+
+static uint64_t HashDescriptorSet(const uint8_t *data, std::size_t size) {
+  uint64_t hash = kFNVOffset;
+  for (std::size_t i = 0; i < size; i++) {
+    hash = (hash ^ data[i]) * kFNVPrime;
+  }
+  return hash;
+}
+
+
+/**
+ * @brief Adds every FileDescriptorProto of the serialized FileDescriptorSet
+ * in `data` to `database` without copying or building them
+ * 
+ */
+static bool IndexDescriptorSet(const uint8_t *data, std::size_t size,
+                               EncodedDescriptorDatabase &database, std::string &error) {
+  if (size > INT_MAX) {
+    error = "descriptor set is too large";
+    return false;
+  }
+
+  io::CodedInputStream input(data, size);
+  uint32_t tag;
+
+  while ((tag = input.ReadTag()) != 0) {
+    if (WireFormatLite::GetTagFieldNumber(tag) != kFileFieldNumber ||
+        WireFormatLite::GetTagWireType(tag) != WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+      if (!WireFormatLite::SkipField(&input, tag)) {
+        error = "descriptor set is not a FileDescriptorSet";
+        return false;
+      }
+      continue;
+    }
+
+    uint32_t length;
+    if (!input.ReadVarint32(&length) || length > size - input.CurrentPosition()) {
+      error = "descriptor set is truncated";
+      return false;
+    }
+
+    if (!database.Add(data + input.CurrentPosition(), length)) {
+      error = "descriptor set contains an invalid or duplicate file";
+      return false;
+    }
+
+    input.Skip(length);
+  }
+
+  if (!input.ConsumedEntireMessage()) {
+    error = "descriptor set is not a FileDescriptorSet";
+    return false;
+  }
+
+  return true;
+}
+
+
+DynamicSchema::~DynamicSchema() {
+  // The cached tables point into pool_
+  ResetFieldTables();
+}
+
+
+std::unique_ptr<DynamicSchema> DynamicSchema::Load(const char *path, const char *root,
+  const char *plans, std::string &error) {
+
+  auto schema = std::make_unique<DynamicSchema>();
+
+  if (!schema->descriptor_set_.Open(path)) {
+    error = std::string("cannot read descriptor set ") + path;
+    return nullptr;
+  }
+
+  const uint8_t *data = schema->descriptor_set_.data();
+  const std::size_t size = schema->descriptor_set_.size();
+
+  if (!IndexDescriptorSet(data, size, schema->database_, error))
+    return nullptr;
+
+  const Descriptor *desc = schema->pool_.FindMessageTypeByName(root);
+  if (!desc) {
+    error = std::string("message ") + root + " not found in " + path;
+    return nullptr;
+  }
+
+  schema->prototype_ = schema->factory_.GetPrototype(desc);
+  schema->hash_ = HashDescriptorSet(data, size);
+
+  if (plans && !LoadFieldTables(plans, schema->hash_, schema->pool_)) {
+    // Failing to write the cache, e.g. in a read-only directory, only
+    // costs the next startup
+    BuildFieldTables(*desc);
+    SaveFieldTables(plans, schema->hash_);
+  }
+
+  return schema;
+}
+
+
+std::unique_ptr<DynamicSchema> DynamicSchema::FromEnv(std::string &error) {
+  const char *path = getenv(kSchemaEnv);
+  const char *root = getenv(kSchemaRootEnv);
+
+  if (!path || !root) {
+    error = std::string(kSchemaEnv) + " and " + kSchemaRootEnv + " must be set";
+    return nullptr;
+  }
+
+  const char *plans = getenv(kPlanCacheEnv);
+  const std::string defplans = std::string(path) + ".plans";
+
+  return Load(path, root, plans ? plans : defplans.c_str(), error);
+}
+
+}
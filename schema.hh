@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/descriptor_database.h>
+#include <google/protobuf/dynamic_message.h>
+#include <google/protobuf/message.h>
+
+#include "utils.hh"
+
+namespace lpmpp {
+
+// Serialized FileDescriptorSet of the target, e.g. written by
+// `protoc --include_imports --descriptor_set_out=<path>`
+static const char * const kSchemaEnv = "LPMPP_DESCRIPTOR_SET";
+// Full name of the root message in the descriptor set
+static const char * const kSchemaRootEnv = "LPMPP_ROOT_MESSAGE";
+// Path of the field plan cache, `<descriptor set>.plans` by default
+static const char * const kPlanCacheEnv = "LPMPP_PLAN_CACHE";
+
+
+/**
+ * @brief A schema loaded at runtime from a serialized FileDescriptorSet.
+ * Messages are built with a DynamicMessageFactory, so that a single mutator
+ * library can serve any schema.
+ * 
+ * The descriptor set is memory mapped and its files indexed in place, only
+ * the files needed by the root message are built. The field tables of all
+ * types reachable from the root are cached next to the descriptor set and
+ * mapped on later startups.
+ * 
+ */
+class DynamicSchema {
+private:
+  MappedFile descriptor_set_;
+  google::protobuf::EncodedDescriptorDatabase database_;
+  google::protobuf::DescriptorPool pool_;
+  google::protobuf::DynamicMessageFactory factory_;
+  const google::protobuf::Message *prototype_ = nullptr;
+  uint64_t hash_ = 0;
+
+public:
+  DynamicSchema() : pool_(&database_), factory_(&pool_) {}
+  ~DynamicSchema();
+
+  DynamicSchema(const DynamicSchema &) = delete;
+  DynamicSchema& operator=(const DynamicSchema &) = delete;
+
+  /**
+   * @brief Loads the descriptor set in `path` and the message named `root`.
+   * Field tables are read from `plans` if it was written for this schema,
+   * otherwise they are built and written to `plans`. Returns nullptr and
+   * sets `error` on failure.
+   * 
+   * @param plans path of the plan cache, or nullptr to not use one
+   */
+  static std::unique_ptr<DynamicSchema> Load(const char *path, const char *root,
+                                             const char *plans, std::string &error);
+
+  /**
+   * @brief Loads the schema named by the `LPMPP_*` environment variables
+   * 
+   */
+  static std::unique_ptr<DynamicSchema> FromEnv(std::string &error);
+
+  /**
+   * @brief The default instance of the root message, `New()` creates the
+   * messages to mutate
+   * 
+   */
+  const google::protobuf::Message & prototype() const {
+    return *prototype_;
+  }
+
+  const google::protobuf::DescriptorPool & pool() const {
+    return pool_;
+  }
+
+  /**
+   * @brief Hash of the serialized descriptor set
+   * 
+   */
+  uint64_t hash() const {
+    return hash_;
+  }
+};
+
+}
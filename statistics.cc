@@ -1,27 +1,255 @@
+#include <algorithm>
+#include <cerrno>
 #include <chrono>
-#include <sstream>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <filesystem>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 #include "statistics.hh"
 
+namespace lpmpp {
+
+/* -------------------------------------- */
+/* --- LatencySummary method definitions  */
+/* -------------------------------------- */
+
+uint64_t LatencySummary::percentile(double p) const {
+  if (total == 0)
+    return 0;
+
+  const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(p / 100.0 * total + 0.5));
+  uint64_t seen = 0;
+
+  for (int i = 0; i < LatencyHistogram::kNumBuckets; i++) {
+    seen += counts[i];
+    if (seen >= rank)
+      return LatencyHistogram::BucketValue(i);
+  }
+
+  return LatencyHistogram::BucketValue(LatencyHistogram::kNumBuckets - 1);
+}
+
+/* -------------------------------------- */
+/* --- StatsView method definitions ----- */
+/* -------------------------------------- */
+
+static const char * const kShmDir = "/dev/shm";
+
+
+StatsView::~StatsView() {
+  if (segment)
+    munmap(const_cast<StatsSegment *>(segment), sizeof(StatsSegment));
+}
+
+
+std::vector<StatsView> StatsView::OpenAll() {
+  std::vector<StatsView> views;
+  std::error_code ec;
+
+  for (const auto &entry : std::filesystem::directory_iterator(kShmDir, ec)) {
+    const std::string name = entry.path().filename().string();
+    if (!name.starts_with(kStatsSegmentPrefix))
+      continue;
+
+    int fd = shm_open(("/" + name).c_str(), O_RDONLY, 0);
+    if (fd < 0)
+      continue;
+
+    void *mem = mmap(nullptr, sizeof(StatsSegment), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED)
+      continue;
+
+    const StatsSegment *segment = static_cast<const StatsSegment *>(mem);
+    if (segment->magic != kStatsSegmentMagic || segment->version != kStatsSegmentVersion) {
+      munmap(mem, sizeof(StatsSegment));
+      continue;
+    }
+
+    views.emplace_back(segment);
+  }
+
+  return views;
+}
+
+
+bool StatsView::alive() const {
+  return kill(segment->pid, 0) == 0 || errno == EPERM;
+}
+
+/* -------------------------------------- */
+/* --- StatsWriter method definitions --- */
+/* -------------------------------------- */
+
+StatsWriter::StatsWriter(const char *path, unsigned flush_ms) : flush_ms(flush_ms) {
+  std::string filename(path);
+  const std::size_t pos = filename.find("%p");
+  if (pos != std::string::npos)
+    filename.replace(pos, 2, std::to_string(getpid()));
+
+  outfile = std::fopen(filename.c_str(), "w");
+  if (!outfile)
+    return;
+
+  std::fprintf(outfile, "time");
+  for (int i = 0; i < NUM_COUNTERS; i++) {
+    std::fprintf(outfile, ",%s", StatsCounterDesc[i]);
+  }
+  for (int i = 0; i < NUM_PHASES; i++) {
+    for (int p = 0; p < kNumSnapshotPercentiles; p++)
+      std::fprintf(outfile, ",%s_%s", StatsPhaseDesc[i], kSnapshotPercentileDesc[p]);
+  }
+  for (int i = 0; i < NUM_OPS; i++) {
+    for (int p = 0; p < kNumSnapshotPercentiles; p++)
+      std::fprintf(outfile, ",op_%s_%s", MutationOpDesc[i], kSnapshotPercentileDesc[p]);
+  }
+  std::fprintf(outfile, ",dropped\n");
+
+  thread = std::thread(&StatsWriter::Run, this);
+}
+
+
+StatsWriter::~StatsWriter() {
+  if (!outfile)
+    return;
+
+  stopping.store(true, std::memory_order_release);
+  thread.join();
+  Drain();
+  std::fclose(outfile);
+}
+
+
+void StatsWriter::Run() {
+  while (!stopping.load(std::memory_order_acquire)) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(flush_ms));
+    Drain();
+  }
+}
+
+
+void StatsWriter::Drain() {
+  StatsSnapshot snapshot;
+  bool written = false;
+
+  while (ring.pop(snapshot)) {
+    std::fprintf(outfile, "%ld", snapshot.time);
+    for (int i = 0; i < NUM_COUNTERS; i++) {
+      std::fprintf(outfile, ",%lu", snapshot.counters[i]);
+    }
+    for (int i = 0; i < NUM_PHASES; i++) {
+      for (int p = 0; p < kNumSnapshotPercentiles; p++)
+        std::fprintf(outfile, ",%lu", snapshot.phases[i][p]);
+    }
+    for (int i = 0; i < NUM_OPS; i++) {
+      for (int p = 0; p < kNumSnapshotPercentiles; p++)
+        std::fprintf(outfile, ",%lu", snapshot.ops[i][p]);
+    }
+    std::fprintf(outfile, ",%lu\n", dropped.load(std::memory_order_relaxed));
+    written = true;
+  }
+
+  if (written)
+    std::fflush(outfile);
+}
+
+/* -------------------------------------- */
+/* --- MutatorStats method definitions -- */
+/* -------------------------------------- */
+
 #ifdef MUTATOR_TRACK_STATS
 
-namespace lpmpp {
+static int64_t Now() {
+  return std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+}
+
+
+MutatorStats::MutatorStats() : shmname("/" + std::string(kStatsSegmentPrefix) + std::to_string(getpid())) {
+  int fd = shm_open(shmname.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+  if (fd < 0)
+    return;
 
-void MutatorStats::flush() {
-  const auto now = std::chrono::system_clock::now();
-  const std::time_t t = std::chrono::system_clock::to_time_t(now);
+  if (ftruncate(fd, sizeof(StatsSegment)) != 0) {
+    close(fd);
+    shm_unlink(shmname.c_str());
+    return;
+  }
 
-  std::stringstream s;
+  void *mem = mmap(nullptr, sizeof(StatsSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mem == MAP_FAILED) {
+    shm_unlink(shmname.c_str());
+    return;
+  }
 
-  s << t << ","
-    << customfuzz << ","
-    << customfuzz_addbuf_parsefail << ","
-    << customfuzz_addbuf_provided << ","
-    << customfuzz_addbuf_parsefail << "\n";
+  // The segment is zero filled by ftruncate, publish the header last
+  segment = static_cast<StatsSegment *>(mem);
+  segment->pid = getpid();
+  segment->start_time = Now();
+  segment->version = kStatsSegmentVersion;
+  std::atomic_thread_fence(std::memory_order_release);
+  segment->magic = kStatsSegmentMagic;
 
-  outfile << s.str();
+  // Optionally write periodic snapshots to a file in the background
+
+  if (const char *path = getenv(kStatsFileEnv)) {
+    const char *flush = getenv(kStatsFlushEnv);
+    const unsigned flush_ms = flush ? std::strtoul(flush, nullptr, 10) : kStatsDefaultFlushMs;
+    writer = std::make_unique<StatsWriter>(path, std::max(flush_ms, kStatsMinFlushMs));
+    if (!writer->ok())
+      writer.reset();
+  }
+}
+
+
+MutatorStats::~MutatorStats() {
+  if (!segment)
+    return;
+
+  munmap(segment, sizeof(StatsSegment));
+  shm_unlink(shmname.c_str());
+}
+
+
+void MutatorStats::snapshot() {
+  if (!segment)
+    return;
+
+  StatsSnapshot snapshot;
+  snapshot.time = Now();
+  for (int i = 0; i < NUM_COUNTERS; i++) {
+    snapshot.counters[i] = segment->counters[i].load();
+  }
+
+  for (int i = 0; i < NUM_PHASES; i++) {
+    LatencySummary summary;
+    summary.add(segment->latencies[i]);
+    for (int p = 0; p < kNumSnapshotPercentiles; p++)
+      snapshot.phases[i][p] = summary.percentile(kSnapshotPercentiles[p]);
+  }
+
+  for (int i = 0; i < NUM_OPS; i++) {
+    LatencySummary summary;
+    summary.add(segment->op_latencies[i]);
+    for (int p = 0; p < kNumSnapshotPercentiles; p++)
+      snapshot.ops[i][p] = summary.percentile(kSnapshotPercentiles[p]);
+  }
+
+  writer->push(snapshot);
 }
 
+
+void MutatorStats::set_name(const char *name) {
+  if (!segment || !name)
+    return;
+
+  strncpy(segment->name, name, kStatsNameLen - 1);
 }
 
 #endif
+
+}
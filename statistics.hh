@@ -1,18 +1,351 @@
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
 #include <cstdint>
-#include <fstream>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/types.h>
 
+#include "operators.hh"
 #include "utils.hh"
 
 namespace lpmpp {
 
-static const char * const kMutatorDefaultOutfile = "/tmp/afl-state.csv";
+// Each instance publishes its stats in a shared memory segment named 
+// /lpmpp-stats-<pid>, aggregated by the lpmpp-stats tool
+static const char * const kStatsSegmentPrefix = "lpmpp-stats-";
+static const uint64_t kStatsSegmentMagic = 0x7374617473706d6cULL;
+static const uint32_t kStatsSegmentVersion = 8;
+static const std::size_t kStatsNameLen = 64;
+static const std::size_t kCacheLineSize = 64;
+
+// Snapshots are pushed to the stats writer every N calls to fuzz
+static const uint64_t kStatsSnapshotCalls = 10000;
+static const unsigned kStatsDefaultFlushMs = 1000;
+// Shortest flush interval, the writer thread would spin below it
+static const unsigned kStatsMinFlushMs = 10;
+static const char * const kStatsFileEnv = "LPMPP_STATS_FILE";
+static const char * const kStatsFlushEnv = "LPMPP_STATS_FLUSH_MS";
+// Latency percentiles written with each snapshot
+static const double kSnapshotPercentiles[] = {50, 90, 99};
+static const char * const kSnapshotPercentileDesc[] = {"p50", "p90", "p99"};
+static const int kNumSnapshotPercentiles = 3;
+
+
+enum StatsCounter {
+  CUSTOMFUZZ,
+  CUSTOMFUZZ_PARSEFAIL,
+  CUSTOMFUZZ_ADDBUF_PROVIDED,
+  CUSTOMFUZZ_ADDBUF_PARSEFAIL,
+  CUSTOMFUZZ_WIRE,
+  CUSTOMFUZZ_DUPLICATE,
+  QUEUEGET_PARSEFAIL,
+  QUEUEGET_DUPLICATE,
+  NUM_COUNTERS,
+};
+
+const char * const StatsCounterDesc[] = {
+  "customfuzz",
+  "customfuzz_parsefail",
+  "customfuzz_addbuf_provided",
+  "customfuzz_addbuf_parsefail",
+  "customfuzz_wire",
+  "customfuzz_duplicate",
+  "queueget_parsefail",
+  "queueget_duplicate",
+};
+
+
+enum StatsPhase {
+  PHASE_FUZZ,
+  PHASE_PARSE,
+  PHASE_MUTATE,
+  PHASE_CROSSOVER,
+  PHASE_SERIALIZE,
+  PHASE_TRIM,
+  PHASE_POST_TRIM,
+  PHASE_POST_PROCESS,
+  NUM_PHASES,
+};
+
+const char * const StatsPhaseDesc[] = {
+  "fuzz",
+  "parse",
+  "mutate",
+  "crossover",
+  "serialize",
+  "trim",
+  "post_trim",
+  "post_process",
+};
+
+
+/**
+ * @brief Monotonic counter on its own cache line. Counters have a single
+ * writer, so increments are a relaxed load and store rather than a locked
+ * read-modify-write.
+ * 
+ */
+struct alignas(kCacheLineSize) AtomicCounter {
+  std::atomic<uint64_t> value;
+
+  void add(uint64_t x) {
+    value.store(value.load(std::memory_order_relaxed) + x, std::memory_order_relaxed);
+  }
+
+  uint64_t load() const {
+    return value.load(std::memory_order_relaxed);
+  }
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free);
+
+
+/**
+ * @brief Latency histogram with HDR-style log buckets. Values below 16ns
+ * have their own bucket, larger values are split into 8 sub-buckets per
+ * power of two, giving a relative error of at most 12.5%.
+ * 
+ */
+struct alignas(kCacheLineSize) LatencyHistogram {
+  static constexpr int kLinearBuckets = 16;
+  static constexpr int kSubBucketBits = 3;
+  static constexpr int kSubBuckets = 1 << kSubBucketBits;
+  static constexpr int kMaxExponent = 40;
+  static constexpr int kNumBuckets = kLinearBuckets + (kMaxExponent - 4) * kSubBuckets;
+
+  std::atomic<uint64_t> buckets[kNumBuckets];
+
+  static int BucketIndex(uint64_t ns) {
+    if (ns < kLinearBuckets)
+      return ns;
+
+    const int exponent = std::bit_width(ns) - 1;
+    if (exponent >= kMaxExponent)
+      return kNumBuckets - 1;
+
+    const int sub = (ns >> (exponent - kSubBucketBits)) & (kSubBuckets - 1);
+    return kLinearBuckets + (exponent - 4) * kSubBuckets + sub;
+  }
+
+  /**
+   * @brief returns the smallest value that falls into bucket `index`
+   * 
+   */
+  static uint64_t BucketValue(int index) {
+    if (index < kLinearBuckets)
+      return index;
+
+    const int exponent = 4 + (index - kLinearBuckets) / kSubBuckets;
+    const uint64_t sub = (index - kLinearBuckets) % kSubBuckets;
+    return (kSubBuckets + sub) << (exponent - kSubBucketBits);
+  }
+
+  void record(uint64_t ns) {
+    std::atomic<uint64_t> &bucket = buckets[BucketIndex(ns)];
+    bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  }
+};
+
+
+/**
+ * @brief Percentiles computed from one or more LatencyHistogram
+ * 
+ */
+class LatencySummary {
+private:
+  uint64_t counts[LatencyHistogram::kNumBuckets] = {};
+  uint64_t total = 0;
+
+public:
+  void add(const LatencyHistogram &histogram) {
+    for (int i = 0; i < LatencyHistogram::kNumBuckets; i++) {
+      const uint64_t n = histogram.buckets[i].load(std::memory_order_relaxed);
+      counts[i] += n;
+      total += n;
+    }
+  }
+
+  uint64_t count() const {
+    return total;
+  }
+
+  /**
+   * @brief returns the lower bound of the bucket containing the `p`th
+   * percentile, in nanoseconds
+   * 
+   */
+  uint64_t percentile(double p) const;
+};
+
+
+/**
+ * @brief Layout of the shared memory segment for one mutator instance
+ * 
+ */
+struct StatsSegment {
+  uint64_t magic;
+  uint32_t version;
+  pid_t pid;
+  int64_t start_time;
+  char name[kStatsNameLen];
+  AtomicCounter counters[NUM_COUNTERS];
+  LatencyHistogram latencies[NUM_PHASES];
+  AtomicCounter op_chosen[NUM_OPS];
+  AtomicCounter op_yields[NUM_OPS];
+  LatencyHistogram op_latencies[NUM_OPS];
+};
+
+
+/**
+ * @brief Read-only view of the stats segment of a running instance
+ * 
+ */
+class StatsView {
+private:
+  const StatsSegment *segment;
+
+public:
+  StatsView(const StatsSegment *segment) : segment(segment) {}
+  StatsView(StatsView &&other) : segment(other.segment) { other.segment = nullptr; }
+  StatsView(const StatsView &) = delete;
+  ~StatsView();
+
+  /**
+   * @brief Maps the stats segments of all instances on the host
+   * 
+   */
+  static std::vector<StatsView> OpenAll();
+
+  /**
+   * @brief returns true if the owning process is still running
+   * 
+   */
+  bool alive() const;
+
+  const StatsSegment &segment_data() const {
+    return *segment;
+  }
+};
+
+
+/**
+ * @brief Bounded single-producer single-consumer ring buffer. Push and pop
+ * never block, push fails if the ring is full.
+ * 
+ */
+template<typename T, std::size_t N>
+class SpscRing {
+  static_assert((N & (N - 1)) == 0, "Capacity must be a power of two");
+
+private:
+  alignas(kCacheLineSize) std::atomic<std::size_t> head{0};
+  alignas(kCacheLineSize) std::atomic<std::size_t> tail{0};
+  T items[N];
+
+public:
+  bool push(const T &item) {
+    const std::size_t t = tail.load(std::memory_order_relaxed);
+    if (t - head.load(std::memory_order_acquire) == N)
+      return false;
+
+    items[t & (N - 1)] = item;
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool pop(T &item) {
+    const std::size_t h = head.load(std::memory_order_relaxed);
+    if (h == tail.load(std::memory_order_acquire))
+      return false;
+
+    item = items[h & (N - 1)];
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+};
+
+
+/**
+ * @brief Counters and latency percentiles at a point in time, taken on the
+ * fuzzing thread. Percentiles are in nanoseconds, since the start.
+ * 
+ */
+struct StatsSnapshot {
+  int64_t time;
+  uint64_t counters[NUM_COUNTERS];
+  uint64_t phases[NUM_PHASES][kNumSnapshotPercentiles];
+  uint64_t ops[NUM_OPS][kNumSnapshotPercentiles];
+};
+
+
+/**
+ * @brief Writes snapshots to a CSV file on a background thread, so that the
+ * fuzzing thread never blocks on disk I/O. Snapshots are dropped, and 
+ * counted, if the writer falls behind.
+ * 
+ */
+class StatsWriter {
+private:
+  SpscRing<StatsSnapshot, 64> ring;
+  std::atomic<bool> stopping{false};
+  std::atomic<uint64_t> dropped{0};
+  std::FILE *outfile;
+  unsigned flush_ms;
+  std::thread thread;
+
+public:
+  /**
+   * @brief Construct a new StatsWriter
+   * 
+   * @param path the output file, any "%p" is replaced with the pid
+   * @param flush_ms milliseconds between writes to the output file
+   */
+  StatsWriter(const char *path, unsigned flush_ms);
+  ~StatsWriter();
+
+  StatsWriter(const StatsWriter &) = delete;
+  StatsWriter& operator=(const StatsWriter &) = delete;
+
+  bool ok() const {
+    return outfile != nullptr;
+  }
+
+  void push(const StatsSnapshot &snapshot) {
+    if (!ring.push(snapshot))
+      dropped.fetch_add(1, std::memory_order_relaxed);
+  }
+
+private:
+  void Run();
+  void Drain();
+};
+
 
 class MutatorStatsBase {
 public:
   void inc_customfuzz() {}
   void inc_customfuzz_parsefail() {}
   void inc_customfuzz_addbuf_parsefail() {}
+  void inc_customfuzz_wire() {}
+  void inc_customfuzz_duplicate() {}
   void add_customfuzz_addbuf_provided(uint64_t x) { UNUSED(x); }
+  void inc_queueget_parsefail() {}
+  void inc_queueget_duplicate() {}
+  void set_name(const char *name) { UNUSED(name); }
+  uint64_t counter(StatsCounter counter) { UNUSED(counter); return 0; }
+  void inc_op_chosen(MutationOp op) { UNUSED(op); }
+  void inc_op_yields(MutationOp op) { UNUSED(op); }
+
+  uint64_t clock() { return 0; }
+  void record(StatsPhase phase, uint64_t start) { UNUSED(phase); UNUSED(start); }
+  void record_op(MutationOp op, uint64_t start) { UNUSED(op); UNUSED(start); }
 
   bool ok() { 
     return true; 
@@ -26,55 +359,136 @@ public:
 class MutatorStats : public MutatorStatsBase {
 #ifdef MUTATOR_TRACK_STATS
 private:
+  StatsSegment *segment = nullptr;
+  std::string shmname;
+  std::unique_ptr<StatsWriter> writer;
   uint64_t c = 0;
-  uint64_t customfuzz = 0;
-  uint64_t customfuzz_parsefail = 0;
-  uint64_t customfuzz_addbuf_provided = 0;
-  uint64_t customfuzz_addbuf_parsefail = 0;
-  std::ofstream outfile;
 
 public:
-  MutatorStats() : outfile(kMutatorDefaultOutfile) {}
-  MutatorStats(const char *outpath) : outfile(outpath) {}
+  MutatorStats();
+  ~MutatorStats();
 
-  void inc_customfuzz() { customfuzz++; }
-  void inc_customfuzz_parsefail() { customfuzz_parsefail++; }
-  void inc_customfuzz_addbuf_parsefail() { customfuzz_addbuf_parsefail++; }
+  MutatorStats(const MutatorStats &) = delete;
+  MutatorStats& operator=(const MutatorStats &) = delete;
+
+  void inc_customfuzz() { add(CUSTOMFUZZ, 1); }
+  void inc_customfuzz_parsefail() { add(CUSTOMFUZZ_PARSEFAIL, 1); }
+  void inc_customfuzz_addbuf_parsefail() { add(CUSTOMFUZZ_ADDBUF_PARSEFAIL, 1); }
+  void inc_customfuzz_wire() { add(CUSTOMFUZZ_WIRE, 1); }
+  void inc_customfuzz_duplicate() { add(CUSTOMFUZZ_DUPLICATE, 1); }
+  void inc_queueget_parsefail() { add(QUEUEGET_PARSEFAIL, 1); }
+  void inc_queueget_duplicate() { add(QUEUEGET_DUPLICATE, 1); }
   void add_customfuzz_addbuf_provided(uint64_t x) { 
-    customfuzz_addbuf_provided += x;
+    add(CUSTOMFUZZ_ADDBUF_PROVIDED, x);
+  }
+
+  /**
+   * @brief returns the value of `counter` for this instance
+   * 
+   */
+  uint64_t counter(StatsCounter counter) {
+    return segment ? segment->counters[counter].load() : 0;
+  }
+
+  void inc_op_chosen(MutationOp op) {
+    if (segment)
+      segment->op_chosen[op].add(1);
+  }
+
+  /**
+   * @brief Counts a queue entry found by a mutant of `op`
+   * 
+   */
+  void inc_op_yields(MutationOp op) {
+    if (segment)
+      segment->op_yields[op].add(1);
+  }
+
+  /**
+   * @brief Sets the instance name shown by lpmpp-stats, e.g. the AFL++ 
+   * sync id
+   * 
+   */
+  void set_name(const char *name);
+
+  /**
+   * @brief returns a monotonic timestamp in nanoseconds, read through the
+   * clock_gettime vDSO
+   * 
+   */
+  uint64_t clock() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  /**
+   * @brief Records the latency of `phase` from `start` to now
+   * 
+   */
+  void record(StatsPhase phase, uint64_t start) {
+    if (segment)
+      segment->latencies[phase].record(clock() - start);
+  }
+
+  /**
+   * @brief Records the latency of a mutation by `op` from `start` to now
+   * 
+   */
+  void record_op(MutationOp op, uint64_t start) {
+    if (segment)
+      segment->op_latencies[op].record(clock() - start);
   }
 
   bool ok() {
-    return !outfile.fail();  
+    return segment != nullptr;
   }
 
   void begin() { c++; }
 
   void end() {
-    if (c % 10000 == 0) {
-      flush();
-      reset();
-    }
+    if (writer && c % kStatsSnapshotCalls == 0)
+      snapshot();
   }
 
 private:
   /**
-   * @brief Flush stats to underlying storage
+   * @brief Push the current counters to the stats writer
    * 
    */
-  void flush();
+  void snapshot();
 
-  void reset() {
-    customfuzz = 0;
-    customfuzz_parsefail = 0;
-    customfuzz_addbuf_provided = 0;
-    customfuzz_addbuf_parsefail = 0;
+  void add(StatsCounter counter, uint64_t x) {
+    if (segment)
+      segment->counters[counter].add(x);
   }
 #else
 public:
   MutatorStats() {}
-  MutatorStats(const char *outpath) { UNUSED(outpath); }
 #endif
 };
 
-}
\ No newline at end of file
+
+
+/**
+ * @brief Records the latency of a phase from construction to destruction.
+ * Compiles to nothing unless MUTATOR_TRACK_STATS is defined.
+ * 
+ */
+class PhaseTimer {
+private:
+  MutatorStats &stats;
+  StatsPhase phase;
+  uint64_t start;
+
+public:
+  PhaseTimer(MutatorStats &stats, StatsPhase phase) : 
+    stats(stats), 
+    phase(phase), 
+    start(stats.clock()) {}
+
+  ~PhaseTimer() {
+    stats.record(phase, start);
+  }
+};
+
+}
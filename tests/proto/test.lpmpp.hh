@@ -0,0 +1,91 @@
+// Generated by protoc-gen-lpmpp.  DO NOT EDIT!
+// source: test.proto
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <google/protobuf/descriptor.h>
+
+#include "test.pb.h"
+#include "visitor.hh"
+
+namespace lpmpp {
+
+template<>
+struct MessageTraits<::lpmpp::test::NestedTestMsg> {
+  static constexpr bool kSpecialized = true;
+  static constexpr int kFieldCount = 8;
+  static constexpr std::array<FieldLayout, 8> kFields = {{
+    {1, ::google::protobuf::FieldDescriptor::TYPE_STRING, false, -1},
+    {2, ::google::protobuf::FieldDescriptor::TYPE_STRING, false, -1},
+    {3, ::google::protobuf::FieldDescriptor::TYPE_BYTES, false, -1},
+    {4, ::google::protobuf::FieldDescriptor::TYPE_BYTES, false, -1},
+    {5, ::google::protobuf::FieldDescriptor::TYPE_DOUBLE, false, 0},
+    {6, ::google::protobuf::FieldDescriptor::TYPE_UINT64, false, 0},
+    {7, ::google::protobuf::FieldDescriptor::TYPE_BOOL, false, 0},
+    {8, ::google::protobuf::FieldDescriptor::TYPE_MESSAGE, false, 0},
+  }};
+
+  static const ::google::protobuf::FieldDescriptor * Field(int index) {
+    static const ::google::protobuf::Descriptor *desc = ::lpmpp::test::NestedTestMsg::descriptor();
+    return desc->field(index);
+  }
+
+  template<typename V>
+  static void Visit(::lpmpp::test::NestedTestMsg &msg, V &v) {
+    if (msg.has_str1()) {
+      v.String(Field(0), *msg.mutable_str1());
+    }
+    if (msg.has_str2()) {
+      v.String(Field(1), *msg.mutable_str2());
+    }
+    if (msg.has_blob1()) {
+      v.String(Field(2), *msg.mutable_blob1());
+    }
+    if (msg.has_blob2()) {
+      v.String(Field(3), *msg.mutable_blob2());
+    }
+    if (msg.has_number()) {
+      v.Value(Field(4), msg.number(), [&msg](double x) {
+        msg.set_number(x);
+      });
+    }
+    if (msg.has_integer()) {
+      v.Value(Field(5), msg.integer(), [&msg](uint64_t x) {
+        msg.set_integer(x);
+      });
+    }
+    if (msg.has_boolean()) {
+      v.Value(Field(6), msg.boolean(), [&msg](bool x) {
+        msg.set_boolean(x);
+      });
+    }
+    if (msg.has_msg()) {
+      v.Message(Field(7), *msg.mutable_msg());
+    }
+  }
+};
+
+template<>
+struct MessageTraits<::lpmpp::test::TestMsg> {
+  static constexpr bool kSpecialized = true;
+  static constexpr int kFieldCount = 1;
+  static constexpr std::array<FieldLayout, 1> kFields = {{
+    {1, ::google::protobuf::FieldDescriptor::TYPE_MESSAGE, true, -1},
+  }};
+
+  static const ::google::protobuf::FieldDescriptor * Field(int index) {
+    static const ::google::protobuf::Descriptor *desc = ::lpmpp::test::TestMsg::descriptor();
+    return desc->field(index);
+  }
+
+  template<typename V>
+  static void Visit(::lpmpp::test::TestMsg &msg, V &v) {
+    for (int i = 0; i < msg.nested_size(); i++) {
+      v.Message(Field(0), *msg.mutable_nested(i));
+    }
+  }
+};
+
+}
@@ -0,0 +1,89 @@
+#include <string>
+#include <gtest/gtest.h>
+
+#include "mutator.hh"
+#include "proto/test.lpmpp.hh"
+
+namespace lpmpp::test {
+
+TEST(DedupTest, FiltersRecentMutants) {
+  MutantFilter filter;
+  auto hash = [](uint64_t value) {
+    return HashBytes(reinterpret_cast<const uint8_t *>(&value), sizeof(value));
+  };
+  const uint64_t ha = hash(1);
+  const uint64_t hb = hash(2);
+
+  ASSERT_NE(ha, hb);
+  ASSERT_TRUE(filter.Insert(ha));
+  ASSERT_FALSE(filter.Insert(ha));
+  ASSERT_TRUE(filter.Insert(hb));
+
+  // Unrelated hashes are rarely taken for duplicates
+  int false_positives = 0;
+  for (uint32_t i = 0; i < kDedupGeneration - 3; i++) {
+    false_positives += !filter.Insert(hash(3 + i));
+  }
+  ASSERT_LT(false_positives, 50);
+
+  // Mutants are forgotten two generations later
+  for (uint32_t i = 0; i < 2 * kDedupGeneration; i++) {
+    filter.Insert(hash(kDedupGeneration + i));
+  }
+  ASSERT_TRUE(filter.Insert(ha));
+}
+
+TEST(DedupTest, RetriesUnchangedMutants) {
+  MutatorState state(1);
+  if (!state.stats().ok())
+    GTEST_SKIP() << "no stats segment";
+
+  // An empty message cannot grow past a max_size of 0 and has no field to
+  // delete or replace, so every mutant is the input itself. It is returned
+  // once the retries are exhausted.
+  unsigned char input[1] = {};
+  unsigned char *out;
+  ASSERT_EQ(fuzz<TestMsg>(&state, input, 0, &out, nullptr, 0, 0), 0u);
+  ASSERT_EQ(state.stats().counter(CUSTOMFUZZ_DUPLICATE), 
+            static_cast<uint64_t>(kDedupRetries + 1));
+}
+
+TEST(DedupTest, RetriesRecentMutants) {
+  TestMsg msg;
+  NestedTestMsg *nested = msg.add_nested();
+  nested->set_str1("abc");
+  nested->set_blob1("def");
+  nested->set_integer(1);
+  std::string input = msg.SerializeAsString();
+  unsigned char *buf = reinterpret_cast<unsigned char *>(input.data());
+  unsigned char *out;
+
+  // Instances with the same seed produce the same first mutant. Each one
+  // publishes its stats under the pid, so they do not overlap.
+  std::string mutant;
+  {
+    MutatorState state(1);
+    const std::size_t size = fuzz<TestMsg>(&state, buf, input.size(), &out, nullptr, 0, 4096);
+    mutant.assign(reinterpret_cast<char *>(out), size);
+  }
+
+  MutatorState state(1);
+  if (!state.stats().ok())
+    GTEST_SKIP() << "no stats segment";
+
+  state.mutant_filter().Insert(HashBytes(reinterpret_cast<const uint8_t *>(mutant.data()), 
+                                         mutant.size()));
+  const std::size_t size = fuzz<TestMsg>(&state, buf, input.size(), &out, nullptr, 0, 4096);
+  ASSERT_NE(std::string(reinterpret_cast<char *>(out), size), mutant);
+  ASSERT_GE(state.stats().counter(CUSTOMFUZZ_DUPLICATE), 1u);
+
+  // The mutant returned is recorded
+  ASSERT_FALSE(state.mutant_filter().Insert(HashBytes(out, size)));
+}
+
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,118 @@
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <gtest/gtest.h>
+
+#include "proto/test.pb.h"
+#include "fieldtable.hh"
+
+namespace lpmpp::test {
+
+using namespace google::protobuf;
+
+static const uint64_t kSchema = 42;
+// Offsets in the plan cache of the field count of the first table, and of
+// its first field after the type name
+static const std::size_t kNumFieldsOffset = 28;
+static const std::size_t kFieldsOffset = 32;
+
+
+static std::string ReadPlans(const std::string &path) {
+  std::ifstream ifs(path, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+}
+
+static void WritePlans(const std::string &path, const std::string &data) {
+  std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+  ofs.write(data.data(), data.size());
+}
+
+class FieldTableTest : public testing::Test {
+protected:
+  const std::string path = testing::TempDir() + "fieldtable.plans";
+  std::string plans;
+
+  void SetUp() override {
+    ResetFieldTables();
+    BuildFieldTables(*TestMsg::descriptor());
+    ASSERT_TRUE(SaveFieldTables(path.c_str(), kSchema));
+    plans = ReadPlans(path);
+    ResetFieldTables();
+  }
+
+  void TearDown() override {
+    std::remove(path.c_str());
+    ResetFieldTables();
+  }
+
+  bool Load(const std::string &data, uint64_t schema = kSchema) {
+    WritePlans(path, data);
+    return LoadFieldTables(path.c_str(), schema, *DescriptorPool::generated_pool());
+  }
+};
+
+TEST_F(FieldTableTest, LoadsSavedTables) {
+  BuildFieldTables(*TestMsg::descriptor());
+  const FieldTable built = GetFieldTable(*NestedTestMsg::descriptor());
+  const int built_id = GetFieldTable(*TestMsg::descriptor()).id;
+  ResetFieldTables();
+
+  ASSERT_TRUE(Load(plans));
+  ASSERT_EQ(NumFieldTables(), 2);
+  ASSERT_EQ(GetFieldTable(*TestMsg::descriptor()).id, built_id);
+
+  const FieldTable &loaded = GetFieldTable(*NestedTestMsg::descriptor());
+  ASSERT_EQ(loaded.id, built.id);
+  ASSERT_EQ(loaded.has_messages, built.has_messages);
+  ASSERT_EQ(loaded.positions, built.positions);
+  ASSERT_EQ(loaded.fields.size(), built.fields.size());
+
+  for (std::size_t i = 0; i < built.fields.size(); i++) {
+    const FieldEntry &a = loaded.fields[i];
+    const FieldEntry &b = built.fields[i];
+    ASSERT_EQ(a.field, b.field);
+    ASSERT_EQ(a.cpp_type, b.cpp_type);
+    ASSERT_EQ(a.type, b.type);
+    ASSERT_EQ(a.index, b.index);
+    ASSERT_EQ(a.repeated, b.repeated);
+    ASSERT_EQ(a.message, b.message);
+    ASSERT_EQ(a.required, b.required);
+    ASSERT_EQ(a.presence, b.presence);
+    ASSERT_EQ(a.oneof, b.oneof);
+    ASSERT_EQ(a.deletable, b.deletable);
+    ASSERT_EQ(a.trim_mask, b.trim_mask);
+  }
+}
+
+TEST_F(FieldTableTest, RejectsStalePlans) {
+  ASSERT_FALSE(Load(plans, kSchema + 1));
+  ASSERT_EQ(NumFieldTables(), 0);
+
+  ASSERT_FALSE(Load(plans.substr(0, plans.size() - 3)));
+  ASSERT_EQ(NumFieldTables(), 0);
+
+  std::string fewer = plans;
+  fewer[kNumFieldsOffset]--;
+  ASSERT_FALSE(Load(fewer));
+  ASSERT_EQ(NumFieldTables(), 0);
+
+  // TestMsg comes first, its only field is a message: as a group it has
+  // the same cpp_type
+  std::string retyped = plans;
+  const std::size_t type = kFieldsOffset + TestMsg::descriptor()->full_name().size() + 5;
+  ASSERT_EQ(retyped[type], FieldDescriptor::TYPE_MESSAGE);
+  retyped[type] = FieldDescriptor::TYPE_GROUP;
+  ASSERT_FALSE(Load(retyped));
+  ASSERT_EQ(NumFieldTables(), 0);
+
+  ASSERT_TRUE(Load(plans));
+  ASSERT_EQ(NumFieldTables(), 2);
+}
+
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
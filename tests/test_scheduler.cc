@@ -0,0 +1,356 @@
+#include <set>
+#include <gtest/gtest.h>
+
+#include "proto/test.lpmpp.hh"
+#include "bloat.hh"
+#include "cmplog.hh"
+#include "dictionary.hh"
+#include "heatmap.hh"
+#include "mutations.hh"
+#include "queue.hh"
+#include "scheduler.hh"
+
+namespace lpmpp::test {
+
+using namespace google::protobuf;
+
+TEST(SchedulerTest, AliasTableFollowsWeights) {
+  protobuf_mutator::RandomEngine random(1);
+  AliasTable table;
+  table.Build({1.0, 0.0, 3.0, 4.0});
+
+  std::size_t counts[4] = {};
+  const std::size_t n = 80000;
+  for (std::size_t i = 0; i < n; i++) {
+    counts[table.Sample(random)]++;
+  }
+
+  ASSERT_EQ(counts[1], 0u);
+  ASSERT_NEAR(counts[0] / double(n), 0.125, 0.01);
+  ASSERT_NEAR(counts[2] / double(n), 0.375, 0.01);
+  ASSERT_NEAR(counts[3] / double(n), 0.5, 0.01);
+}
+
+TEST(SchedulerTest, FavoursProductiveOperators) {
+  protobuf_mutator::RandomEngine random(1);
+  Scheduler scheduler;
+
+  ASSERT_NEAR(scheduler.Probability(OP_CROSSOVER), kCrossoverShare, 1e-9);
+
+  // Only deletions find new entries
+  for (uint64_t i = 0; i < kSchedulerEpoch; i++) {
+    MutationTag tag;
+    tag.op = scheduler.Next(random);
+    scheduler.Chosen(tag);
+    if (tag.op == OP_DELETE && i % 4 == 0)
+      scheduler.Reward(tag);
+  }
+
+  ASSERT_GT(scheduler.Probability(OP_DELETE), 0.5);
+  for (int op = 0; op < NUM_OPS; op++) {
+    ASSERT_GE(scheduler.Probability(static_cast<MutationOp>(op)), kSchedulerFloor / 2);
+  }
+}
+
+TEST(SchedulerTest, DetectsBloat) {
+  Scheduler scheduler;
+  BloatDetector bloat;
+
+  for (uint32_t i = 0; i < kBloatMutantWindow; i++) {
+    ASSERT_EQ(bloat.Mutant(100 + i % 20), i + 1 == kBloatMutantWindow);
+  }
+
+  ASSERT_FALSE(bloat.bloated());
+  ASSERT_EQ(bloat.SizeBudget(100, 4096), 4096u);
+
+  // Mutants grow tenfold until the window is dominated by large ones
+  for (uint32_t i = 0; i < 3 * kBloatMutantWindow; i++) {
+    bloat.Mutant(1000 + i % 200);
+  }
+
+  ASSERT_TRUE(bloat.bloated());
+  ASSERT_GT(bloat.drift(), 5.0);
+  ASSERT_LT(bloat.SizeBudget(100, 4096), 300u);
+  ASSERT_EQ(bloat.SizeBudget(1000, 4096), 1000u);
+  ASSERT_TRUE(bloat.Bloated(1000));
+  ASSERT_FALSE(bloat.Bloated(100));
+  ASSERT_TRUE(bloat.Retrim(1));
+  ASSERT_FALSE(bloat.Retrim(1));
+
+  const double before = scheduler.Probability(OP_DELETE);
+  scheduler.Bias(OP_DELETE, bloat.DeleteBias());
+  ASSERT_NEAR(bloat.DeleteBias(), kBloatMaxBias, 1e-9);
+  ASSERT_GT(scheduler.Probability(OP_DELETE), 2 * before);
+}
+
+TEST(SchedulerTest, HeatsRewardedFields) {
+  const FieldDescriptor *nested = TestMsg::descriptor()->FindFieldByName("nested");
+  const FieldDescriptor *str1 = NestedTestMsg::descriptor()->FindFieldByName("str1");
+  const FieldDescriptor *blob1 = NestedTestMsg::descriptor()->FindFieldByName("blob1");
+  FieldHeatmap heatmap;
+
+  MutationTag hot;
+  hot.op = OP_REPLACE;
+  hot.field = str1;
+  hot.path.fields[0] = nested;
+  hot.path.depth = 1;
+
+  MutationTag cold = hot;
+  cold.field = blob1;
+
+  for (uint64_t i = 0; i < kHeatmapEpoch; i++) {
+    MutationTag &tag = i % 2 ? hot : cold;
+    heatmap.Chosen(tag);
+    if (tag.field == str1 && i % 8 == 1)
+      heatmap.Reward(tag);
+  }
+
+  const double *weights = heatmap.Weights(GetFieldTable(*NestedTestMsg::descriptor()));
+  ASSERT_GT(weights[str1->index()], 1.0);
+  ASSERT_LT(weights[blob1->index()], 1.0);
+  ASSERT_GT(heatmap.Heat(nested), 0.0);
+}
+
+TEST(SchedulerTest, MutantsAreTagged) {
+  Mutator mutator;
+  mutator.Seed(1);
+
+  TestMsg msg;
+  NestedTestMsg *nested = msg.add_nested();
+  nested->set_str1("abc");
+  nested->set_blob1("def");
+
+  for (int i = 0; i < 1000; i++) {
+    const MutationTag &tag = mutator.MutateOne(msg, 4096, mutator.NextOp());
+    ASSERT_TRUE(tag.valid());
+    ASSERT_NE(tag.field, nullptr);
+    if (tag.field->containing_type() == NestedTestMsg::descriptor()) {
+      ASSERT_GE(tag.path.depth, 1);
+      ASSERT_EQ(tag.path.fields[0]->name(), "nested");
+    }
+    ASSERT_TRUE(msg.IsInitialized());
+  }
+}
+
+TEST(SchedulerTest, ReplacesTypedValues) {
+  static_assert(MessageTraits<TestMsg>::kFieldCount == 1);
+  static_assert(MessageTraits<NestedTestMsg>::kFields[4].type == FieldDescriptor::TYPE_DOUBLE);
+
+  Mutator mutator;
+  mutator.Seed(1);
+
+  TestMsg msg;
+  NestedTestMsg *nested = msg.add_nested();
+  nested->set_str1("abc");
+  nested->set_blob1("def");
+  nested->mutable_msg()->set_str1("ghi");
+  nested->mutable_msg()->set_blob1("jkl");
+  nested->mutable_msg()->set_integer(1);
+
+  int changed = 0;
+
+  for (int i = 0; i < 1000; i++) {
+    const std::string before = msg.SerializeAsString();
+    const MutationTag &tag = mutator.MutateOne(msg, 4096, OP_REPLACE);
+    changed += msg.SerializeAsString() != before;
+
+    ASSERT_EQ(tag.op, OP_REPLACE);
+    ASSERT_EQ(tag.field->containing_type(), NestedTestMsg::descriptor());
+    ASSERT_GE(tag.path.depth, 1);
+    ASSERT_EQ(tag.path.fields[0]->name(), "nested");
+    ASSERT_EQ(msg.nested_size(), 1);
+    ASSERT_TRUE(msg.nested(0).msg().has_integer());
+  }
+
+  ASSERT_GT(changed, 900);
+}
+
+TEST(SchedulerTest, InjectsStringOperands) {
+  const FieldDescriptor *str1 = NestedTestMsg::descriptor()->FindFieldByName("str1");
+  const std::string logged = "!KIL";
+  const std::string expected = "!KILL";
+
+  CmpOperands operands;
+  operands.AddStrings(reinterpret_cast<const uint8_t *>(logged.data()), logged.size(), 
+                      reinterpret_cast<const uint8_t *>(expected.data()), expected.size());
+
+  Mutator mutator;
+  mutator.Seed(1);
+
+  TestMsg msg;
+  NestedTestMsg *nested = msg.add_nested();
+  nested->set_str1("!KIL-x");
+  nested->set_blob1("def");
+
+  // Only the prefix compared with the operand is replaced
+  const MutationTag &tag = mutator.InjectOne(msg, 4096, operands);
+  ASSERT_EQ(tag.op, OP_INJECT);
+  ASSERT_EQ(tag.field, str1);
+  ASSERT_EQ(tag.path.depth, 1);
+  ASSERT_EQ(msg.nested(0).str1(), "!KILL-x");
+  ASSERT_EQ(msg.nested(0).blob1(), "def");
+
+  // No value starts with a logged operand
+  nested->set_str1("x!KIL");
+  ASSERT_FALSE(mutator.InjectOne(msg, 4096, operands).valid());
+  ASSERT_EQ(msg.nested(0).str1(), "x!KIL");
+}
+
+TEST(SchedulerTest, InjectsIntegerLowBytes) {
+  const FieldDescriptor *integer = NestedTestMsg::descriptor()->FindFieldByName("integer");
+
+  CmpOperands operands;
+  operands.AddIntegers(0x41, 0x7a, 1);
+
+  Mutator mutator;
+  mutator.Seed(1);
+
+  TestMsg msg;
+  NestedTestMsg *nested = msg.add_nested();
+  nested->set_str1("abc");
+  nested->set_blob1("def");
+  nested->set_integer(0x12345641);
+
+  const MutationTag &tag = mutator.InjectOne(msg, 4096, operands);
+  ASSERT_EQ(tag.op, OP_INJECT);
+  ASSERT_EQ(tag.field, integer);
+  ASSERT_EQ(msg.nested(0).integer(), 0x1234567au);
+
+  // The low byte no longer matches a logged operand of its width
+  nested->set_integer(0x4100);
+  ASSERT_FALSE(mutator.InjectOne(msg, 4096, operands).valid());
+  ASSERT_EQ(msg.nested(0).integer(), 0x4100u);
+}
+
+TEST(SchedulerTest, InjectsWithinMaxSize) {
+  const std::string logged = "!KIL";
+  const std::string longer(kMaxCmpOperandSize, 'K');
+  const std::string shorter = "!";
+
+  CmpOperands operands;
+  operands.AddStrings(reinterpret_cast<const uint8_t *>(logged.data()), logged.size(), 
+                      reinterpret_cast<const uint8_t *>(longer.data()), longer.size());
+
+  Mutator mutator;
+  mutator.Seed(1);
+
+  TestMsg msg;
+  NestedTestMsg *nested = msg.add_nested();
+  nested->set_str1(logged);
+  nested->set_blob1("def");
+  const std::size_t size = msg.ByteSizeLong();
+
+  // Growing past max_size is skipped
+  ASSERT_FALSE(mutator.InjectOne(msg, size, operands).valid());
+  ASSERT_EQ(msg.nested(0).str1(), logged);
+
+  ASSERT_EQ(mutator.InjectOne(msg, size + longer.size(), operands).op, OP_INJECT);
+  ASSERT_EQ(msg.nested(0).str1(), longer);
+
+  // Shrinking is always allowed
+  operands.Clear();
+  operands.AddStrings(reinterpret_cast<const uint8_t *>(longer.data()), longer.size(), 
+                      reinterpret_cast<const uint8_t *>(shorter.data()), shorter.size());
+  ASSERT_EQ(mutator.InjectOne(msg, size, operands).op, OP_INJECT);
+  ASSERT_EQ(msg.nested(0).str1(), shorter);
+}
+
+TEST(SchedulerTest, IndexesQueueEntries) {
+  const FieldDescriptor *str1 = NestedTestMsg::descriptor()->FindFieldByName("str1");
+  const FieldDescriptor *integer = NestedTestMsg::descriptor()->FindFieldByName("integer");
+
+  TestMsg a;
+  NestedTestMsg *nested = a.add_nested();
+  nested->set_str1("abc");
+  nested->set_blob1("def");
+  nested->mutable_msg()->set_str1("ghi");
+  nested->mutable_msg()->set_blob1("jkl");
+
+  // Same shape, other values
+  TestMsg b(a);
+  b.mutable_nested(0)->set_str1("xyz");
+  b.mutable_nested(0)->mutable_msg()->set_blob1("");
+
+  TestMsg c(a);
+  c.mutable_nested(0)->mutable_msg()->set_integer(1);
+
+  ASSERT_EQ(StructuralHash(a), StructuralHash(b));
+  ASSERT_NE(StructuralHash(a), StructuralHash(c));
+
+  SplicePool pool;
+  FieldHeatmap heatmap;
+  for (const TestMsg *msg : {&a, &b, &c}) {
+    const uint32_t id = pool.Add(reinterpret_cast<const uint8_t *>("entry"));
+    WalkStructure(*msg, [&](const Message &, const FieldTable &table, const FieldEntry &entry, 
+                            uint32_t depth) {
+      pool.Present(id, table, entry, depth);
+      heatmap.Present(id, table, entry);
+    });
+  }
+
+  int count;
+  const uint32_t *donors = pool.Donors(*integer, count);
+  ASSERT_EQ(count, 1);
+  ASSERT_EQ(donors[0], 2u);
+
+  // str1 is set twice in each entry, but counted once
+  ASSERT_EQ(pool.Seen(*str1), 3u);
+  ASSERT_EQ(heatmap.Seen(*str1), 3u);
+  ASSERT_EQ(pool.depth(0), 3u);
+}
+
+TEST(SchedulerTest, LearnsFieldTokens) {
+  const FieldDescriptor *str1 = NestedTestMsg::descriptor()->FindFieldByName("str1");
+  const FieldDescriptor *blob1 = NestedTestMsg::descriptor()->FindFieldByName("blob1");
+  const FieldTable &table = GetFieldTable(*NestedTestMsg::descriptor());
+
+  Dictionary dictionary;
+  std::string error;
+  ASSERT_TRUE(dictionary.Load("../tests/fixtures/tokens.dict", error)) << error;
+  ASSERT_EQ(dictionary.size(), 3u);
+
+  // A dictionary token found in a value, and the value itself
+  dictionary.Learn(table, table.entry(*str1), "a GET b");
+  ASSERT_EQ(dictionary.size(), 4u);
+
+  std::set<std::string> learned;
+  std::set<std::string> other;
+  for (uint64_t r = 0; r < 64; r++) {
+    learned.insert(*dictionary.Choose(*str1, r));
+    other.insert(*dictionary.Choose(*blob1, r));
+  }
+
+  ASSERT_EQ(learned, (std::set<std::string>{"GET", "a GET b", std::string("\x00\x01", 2), 
+                                            "Host: \"x\""}));
+  ASSERT_EQ(other, (std::set<std::string>{"GET", std::string("\x00\x01", 2), "Host: \"x\""}));
+
+  ASSERT_FALSE(dictionary.Load("../tests/fixtures/testmsg1.pb.txt", error));
+}
+
+TEST(SchedulerTest, ReservesDictionaryTokens) {
+  const FieldDescriptor *str1 = NestedTestMsg::descriptor()->FindFieldByName("str1");
+  const FieldDescriptor *blob1 = NestedTestMsg::descriptor()->FindFieldByName("blob1");
+  const FieldTable &table = GetFieldTable(*NestedTestMsg::descriptor());
+
+  // Learned values stop being added once they reach their share
+  Dictionary dictionary;
+  for (std::size_t i = 0; i < kMaxLearnedTokens + 16; i++)
+    dictionary.Learn(table, table.entry(*str1), "value" + std::to_string(i));
+  ASSERT_EQ(dictionary.size(), kMaxLearnedTokens);
+
+  const std::string token = "TOKEN";
+  dictionary.Add(reinterpret_cast<const uint8_t *>(token.data()), token.size());
+  ASSERT_EQ(dictionary.size(), kMaxLearnedTokens + 1);
+  ASSERT_EQ(*dictionary.Choose(*blob1, 0), token);
+
+  // Values already in the trie are still recorded for the field
+  dictionary.Learn(table, table.entry(*blob1), token);
+  ASSERT_EQ(*dictionary.Choose(*blob1, 1), token);
+}
+
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -1,4 +1,5 @@
 #include <iostream>
+#include <vector>
 #include <fcntl.h>
 #include <fstream>
 #include <gtest/gtest.h>
@@ -205,7 +206,175 @@ TEST_F(TrimmerTest, TrimsStrings) {
   trimmer.TrimOne();
   trimmer.Revert();
   ASSERT_STREQ(nestedmsg->str1().c_str(), "zzzzaaaa");
+  ASSERT_EQ(trimmer.trim_type(), TrimType::CHUNKS);
+}
+
+TEST_F(TrimmerTest, TrimsChunks) {
+  std::unique_ptr<TestMsg> msg = std::make_unique<TestMsg>();
+  NestedTestMsg *nested = msg->add_nested();
+  nested->set_str1("a");
+  nested->set_blob1("junk0junk1junk2junk3, junk4;junk5 !KILL");
+  nested->set_blob2("!HELLO junk6junk7");
+
+  Trimmer trimmer(std::move(msg));
+  const TestMsg *testmsg = static_cast<const TestMsg *>(trimmer.message());
+
+  // Keep any step that preserves the magic values, as a target would
+  int i = 0;
+  while (!trimmer.done() && i++ < 1000) {
+    trimmer.TrimOne();
+
+    if (testmsg->nested_size() != 1 || 
+        testmsg->nested()[0].blob1().find("!KILL") == std::string::npos ||
+        testmsg->nested()[0].blob2().find("!HELLO") == std::string::npos) {
+      trimmer.Revert();
+    }
+  }
+
   ASSERT_TRUE(trimmer.done());
+  ASSERT_STREQ(testmsg->nested()[0].blob1().c_str(), "!KILL");
+  ASSERT_STREQ(testmsg->nested()[0].blob2().c_str(), "!HELLO");
+}
+
+TEST_F(TrimmerTest, ClampsStaleChunks) {
+  TestMsg msg;
+  NestedTestMsg *nested = msg.add_nested();
+  nested->set_str1("a");
+  nested->set_blob1("x");
+
+  // The cursor of a 9-byte value which had a chunk of 8 removed
+  ChunkTrimTask::Cursor cursor;
+  cursor.chunk = 8;
+  cursor.pos = 0;
+
+  ChunkTrimTask task(*nested, *NestedTestMsg::descriptor()->FindFieldByName("blob1"), 
+                     "blob1", -1, cursor);
+  task.Trim();
+
+  ASSERT_EQ(cursor.removed, 1u);
+  ASSERT_EQ(cursor.chunk, 8u);
+  ASSERT_EQ(nested->blob1(), "");
+}
+
+TEST_F(TrimmerTest, HalvesChunksPastTail) {
+  TestMsg msg;
+  NestedTestMsg *nested = msg.add_nested();
+  nested->set_str1("a");
+  const std::string value(65, 'x');
+  nested->set_blob1(value);
+
+  ChunkTrimTask::Cursor cursor;
+  ChunkTrimTask task(*nested, *NestedTestMsg::descriptor()->FindFieldByName("blob1"), 
+                     "blob1", -1, cursor);
+
+  // Reject every removal, the tail of each pass is clamped to one byte
+  std::vector<std::size_t> removed;
+  while (!task.done() && removed.size() < 19) {
+    task.Trim();
+    removed.push_back(cursor.removed);
+    nested->set_blob1(value);
+    task.Reject();
+  }
+
+  ASSERT_EQ(removed, (std::vector<std::size_t>{64, 1, 32, 32, 1, 16, 16, 16, 16, 1, 
+                                               8, 8, 8, 8, 8, 8, 8, 8, 1}));
+}
+
+TEST_F(TrimmerTest, CollapsesDuplicates) {
+  std::unique_ptr<TestMsg> msg = std::make_unique<TestMsg>();
+  msg->CopyFrom(msg2);
+  msg->add_nested()->CopyFrom(msg2.nested()[0]);
+  msg->add_nested()->CopyFrom(msg2.nested()[2]);
+  msg->add_nested()->CopyFrom(msg2.nested()[0]);
+
+  Trimmer trimmer(std::move(msg));
+  const TestMsg *testmsg = static_cast<const TestMsg *>(trimmer.message());
+  ASSERT_EQ(testmsg->nested_size(), 7);
+
+  trimmer.TrimOne();
+  ASSERT_EQ(testmsg->nested_size(), 4);
+  ASSERT_STREQ(testmsg->nested()[0].str1().c_str(), "a");
+  ASSERT_STREQ(testmsg->nested()[1].str1().c_str(), "b");
+  ASSERT_STREQ(testmsg->nested()[2].str1().c_str(), "c");
+  ASSERT_STREQ(testmsg->nested()[3].str1().c_str(), "d");
+
+  // Falls back to removing elements one at a time
+  trimmer.Revert();
+  ASSERT_EQ(testmsg->nested_size(), 7);
+
+  trimmer.TrimOne();
+  ASSERT_EQ(testmsg->nested_size(), 7);
+  ASSERT_FALSE(testmsg->nested()[0].has_integer());
+}
+
+TEST_F(TrimmerTest, LearnsAcrossSessions) {
+  TrimHistory history;
+
+  // Leaf fields are always redundant, the nested message is always necessary
+  for (uint32_t i = 0; i < TrimHistory::kMinSamples; i++) {
+    std::unique_ptr<Message> msg = std::make_unique<TestMsg>();
+    msg->CopyFrom(msg1);
+
+    Trimmer trimmer(std::move(msg), &history);
+    trimmer.TrimOne();
+    trimmer.TrimOne();
+    trimmer.TrimOne();
+    trimmer.TrimOne();
+    trimmer.Revert();
+  }
+
+  std::unique_ptr<Message> msg = std::make_unique<TestMsg>();
+  msg->CopyFrom(msg1);
+
+  Trimmer trimmer(std::move(msg), &history);
+  const TestMsg *testmsg = static_cast<const TestMsg *>(trimmer.message());
+
+  // All redundant fields are removed in a single step
+  trimmer.TrimOne();
+  ASSERT_EQ(testmsg->nested_size(), 1);
+  const NestedTestMsg *nestedmsg = &testmsg->nested()[0];
+  ASSERT_FALSE(nestedmsg->has_str2());
+  ASSERT_FALSE(nestedmsg->has_blob2());
+  ASSERT_FALSE(nestedmsg->has_integer());
+
+  // Removing the nested message is skipped
+  trimmer.TrimOne();
+  ASSERT_EQ(trimmer.trim_type(), TrimType::STRINGS);
+  ASSERT_EQ(testmsg->nested_size(), 1);
+}
+
+TEST_F(TrimmerTest, BulkTrimFallback) {
+  TrimHistory history;
+
+  for (uint32_t i = 0; i < TrimHistory::kMinSamples; i++) {
+    std::unique_ptr<Message> msg = std::make_unique<TestMsg>();
+    msg->CopyFrom(msg1);
+
+    Trimmer trimmer(std::move(msg), &history);
+    trimmer.TrimOne();
+    trimmer.TrimOne();
+    trimmer.TrimOne();
+  }
+
+  std::unique_ptr<Message> msg = std::make_unique<TestMsg>();
+  msg->CopyFrom(msg1);
+
+  Trimmer trimmer(std::move(msg), &history);
+  const TestMsg *testmsg = static_cast<const TestMsg *>(trimmer.message());
+
+  trimmer.TrimOne();
+  trimmer.Revert();
+
+  // Fields are removed one at a time after the bulk removal fails
+  const NestedTestMsg *nestedmsg = &testmsg->nested()[0];
+  ASSERT_TRUE(nestedmsg->has_str2());
+  ASSERT_TRUE(nestedmsg->has_blob2());
+  ASSERT_TRUE(nestedmsg->has_integer());
+
+  trimmer.TrimOne();
+  nestedmsg = &testmsg->nested()[0];
+  int present = nestedmsg->has_str2() + nestedmsg->has_blob2() + nestedmsg->has_integer();
+  ASSERT_EQ(present, 2);
 }
 
 };
@@ -0,0 +1,116 @@
+#include <gtest/gtest.h>
+#include <google/protobuf/util/message_differencer.h>
+
+#include "proto/test.pb.h"
+#include "mutations.hh"
+#include "wire.hh"
+
+namespace lpmpp::test {
+
+using namespace google::protobuf;
+
+static TestMsg NestedFixture() {
+  TestMsg msg;
+  NestedTestMsg *nested = msg.add_nested();
+  nested->set_str1("abc");
+  nested->set_blob1("def");
+  nested->mutable_msg()->set_str1("ghi");
+  nested->mutable_msg()->set_blob1("jkl");
+  nested->mutable_msg()->set_integer(1);
+
+  NestedTestMsg *second = msg.add_nested();
+  second->set_str1("mno");
+  second->set_blob1("pqr");
+  second->set_number(2.5);
+  return msg;
+}
+
+TEST(WireTest, IndexesLeaves) {
+  const TestMsg msg = NestedFixture();
+  const std::string wire = msg.SerializeAsString();
+  const uint8_t *buf = reinterpret_cast<const uint8_t *>(wire.data());
+
+  WireIndex index;
+  ASSERT_TRUE(index.Build(buf, wire.size(), *TestMsg::descriptor()));
+  ASSERT_EQ(index.leaf_entries().size(), 8u);
+  ASSERT_EQ(index.entries().size(), 11u);
+
+  // Truncated and malformed inputs are rejected
+  ASSERT_FALSE(index.Build(buf, wire.size() - 1, *TestMsg::descriptor()));
+  const uint8_t group[] = {0x0b, 0x0c};
+  ASSERT_FALSE(index.Build(group, sizeof(group), *TestMsg::descriptor()));
+}
+
+TEST(WireTest, PatchesLengthPrefixes) {
+  TestMsg msg = NestedFixture();
+  const std::string wire = msg.SerializeAsString();
+
+  WireIndex index;
+  ASSERT_TRUE(index.Build(reinterpret_cast<const uint8_t *>(wire.data()), wire.size(), 
+                          *TestMsg::descriptor()));
+
+  // Grow the innermost str1 past 127 bytes, which widens every prefix
+  const WireField *inner = nullptr;
+  for (uint32_t i : index.leaf_entries()) {
+    const WireField &leaf = index.entries()[i];
+    if (leaf.field->name() == "str1" && leaf.parent >= 0 && index.entries()[leaf.parent].parent >= 0)
+      inner = &leaf;
+  }
+  ASSERT_NE(inner, nullptr);
+
+  const std::string value(200, 'x');
+  std::vector<uint8_t> out;
+  const std::size_t size = index.Rewrite(*inner, reinterpret_cast<const uint8_t *>(value.data()), 
+                                         value.size(), out);
+  ASSERT_EQ(size, index.RewrittenSize(*inner, value.size()));
+
+  TestMsg mutant;
+  ASSERT_TRUE(mutant.ParseFromArray(out.data(), size));
+  msg.mutable_nested(0)->mutable_msg()->set_str1(value);
+  ASSERT_TRUE(util::MessageDifferencer::Equals(msg, mutant));
+  ASSERT_EQ(size, msg.ByteSizeLong());
+}
+
+TEST(WireTest, ReplacesOneLeaf) {
+  Mutator mutator;
+  mutator.Seed(1);
+
+  const TestMsg msg = NestedFixture();
+  const std::string wire = msg.SerializeAsString();
+  WireIndex index;
+  ASSERT_TRUE(index.Build(reinterpret_cast<const uint8_t *>(wire.data()), wire.size(), 
+                          *TestMsg::descriptor()));
+
+  std::vector<uint8_t> out;
+  int changed = 0;
+
+  for (int i = 0; i < 1000; i++) {
+    std::size_t size = 0;
+    const MutationTag &tag = mutator.ReplaceWire(index, 4096, out, size);
+    ASSERT_TRUE(tag.valid());
+    ASSERT_EQ(tag.op, OP_REPLACE);
+    ASSERT_GE(tag.path.depth, 1);
+    ASSERT_EQ(tag.path.fields[0]->name(), "nested");
+
+    TestMsg mutant;
+    ASSERT_TRUE(mutant.ParseFromArray(out.data(), size));
+    ASSERT_EQ(mutant.nested_size(), 2);
+    changed += !util::MessageDifferencer::Equals(msg, mutant);
+  }
+
+  ASSERT_GT(changed, 500);
+
+  // Nothing fits below the size of the input
+  std::size_t size = 0;
+  int fitted = 0;
+  for (int i = 0; i < 100; i++)
+    fitted += mutator.ReplaceWire(index, wire.size() - 8, out, size).valid();
+  ASSERT_EQ(fitted, 0);
+}
+
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
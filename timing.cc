@@ -0,0 +1,80 @@
+#include <algorithm>
+
+#include "timing.hh"
+
+namespace lpmpp {
+
+/* -------------------------------------- */
+/* --- TimingModel method definitions --- */
+/* -------------------------------------- */
+
+void TimingModel::Select(uint64_t structure) {
+  const uint32_t slot = index.Insert(structure, structures.size());
+  if (slot == structures.size())
+    structures.emplace_back();
+
+  current = slot;
+}
+
+
+void TimingModel::Ran() {
+  if (!pending)
+    return;
+
+  pending = false;
+  const double elapsed = MonotonicNs() - start;
+
+  global.Add(size, elapsed, kTimingGlobalDecay);
+  if (current != kNone)
+    structures[current].fit.Add(size, elapsed, kTimingEntryDecay);
+}
+
+
+std::size_t TimingModel::SizeBudget(std::size_t entry_size, std::size_t max_size) const {
+  const TimeFit *e = entry();
+  const TimeFit &fit = e && e->n >= kTimingMinSamples ? *e : global;
+  const double slope = fit.slope();
+
+  if (fit.n < kTimingMinSamples || slope <= 0 || entry_size >= max_size)
+    return max_size;
+
+  const double base = fit.Predict(entry_size);
+  if (base <= 0)
+    return max_size;
+
+  const double target = kTimingSlack * std::max(base, global.mean());
+  const double budget = entry_size + (target - base) / slope;
+
+  return budget >= max_size ? max_size : std::max<std::size_t>(entry_size, budget);
+}
+
+
+bool TimingModel::AllowCrossover() {
+  // Spread the kept crossovers evenly instead of drawing them
+  crossover_credit += std::max(kTimingMinCrossover, 1.0 / Slowdown());
+  if (crossover_credit < 1.0)
+    return false;
+
+  crossover_credit -= 1.0;
+  return true;
+}
+
+
+bool TimingModel::Retrim() {
+  if (current == kNone || structures[current].retrimmed || Slowdown() < kTimingSlowEntry)
+    return false;
+
+  structures[current].retrimmed = true;
+  return true;
+}
+
+
+double TimingModel::Slowdown() const {
+  const TimeFit *e = entry();
+  if (!e || e->n < kTimingMinSamples || global.n < kTimingMinSamples || global.mean() <= 0)
+    return 1.0;
+
+  return std::max(1.0, e->mean() / global.mean());
+}
+
+}
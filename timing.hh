@@ -0,0 +1,161 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "queue.hh"
+
+namespace lpmpp {
+
+// Weight of past samples in the fit of a structure, and in the global fit
+static const double kTimingEntryDecay = 1.0 - 1.0 / 1024;
+static const double kTimingGlobalDecay = 1.0 - 1.0 / 65536;
+// Samples a fit needs before it steers anything
+static const double kTimingMinSamples = 64;
+// Mutants may run this many times as long as their entry, or as the mean
+static const double kTimingSlack = 2.0;
+// Entries this many times slower than the mean are trimmed again, once
+static const double kTimingSlowEntry = 4.0;
+// Lowest share of crossovers kept for slow entries
+static const double kTimingMinCrossover = 0.1;
+
+
+/**
+ * @brief returns a monotonic timestamp in nanoseconds
+ * 
+ */
+inline uint64_t MonotonicNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+/**
+ * @brief Exponentially decayed least squares fit of execution time against
+ * serialized size
+ * 
+ */
+struct TimeFit {
+  double n = 0;
+  double sx = 0;
+  double sy = 0;
+  double sxx = 0;
+  double sxy = 0;
+
+  void Add(double x, double y, double decay) {
+    n = n * decay + 1;
+    sx = sx * decay + x;
+    sy = sy * decay + y;
+    sxx = sxx * decay + x * x;
+    sxy = sxy * decay + x * y;
+  }
+
+  double mean() const {
+    return n > 0 ? sy / n : 0;
+  }
+
+  /**
+   * @brief returns the time added per byte, 0 if the sizes do not vary
+   * 
+   */
+  double slope() const {
+    const double var = n * sxx - sx * sx;
+    return var > 0 ? (n * sxy - sx * sy) / var : 0;
+  }
+
+  double Predict(double x) const {
+    return n > 0 ? mean() + slope() * (x - sx / n) : 0;
+  }
+};
+
+
+/**
+ * @brief Execution time of the mutants of each structure of queue entries,
+ * measured from the end of fuzz to afl_custom_post_run. Mutants of slow
+ * structures are kept small, cross over less, and their entries are
+ * trimmed again.
+ * 
+ */
+class TimingModel {
+private:
+  static constexpr uint32_t kNone = UINT32_MAX;
+
+  struct Structure {
+    TimeFit fit;
+    bool retrimmed = false;
+  };
+
+  TimeFit global;
+  HashIndex<uint32_t> index;
+  std::vector<Structure> structures;
+  uint32_t current = kNone;
+  // The mutant being run
+  uint64_t start = 0;
+  double size = 0;
+  bool pending = false;
+  double crossover_credit = 0;
+
+public:
+  /**
+   * @brief Makes `structure` the structure of the entry being fuzzed
+   * 
+   */
+  void Select(uint64_t structure);
+
+  /**
+   * @brief Records that fuzz returned a mutant of `size` bytes
+   * 
+   */
+  void Produced(std::size_t size) {
+    start = MonotonicNs();
+    this->size = size;
+    pending = true;
+  }
+
+  /**
+   * @brief Records that the target ran the last mutant
+   * 
+   */
+  void Ran();
+
+  /**
+   * @brief returns the largest mutant of an entry of `entry_size` bytes
+   * expected to run within kTimingSlack times as long as the entry or the
+   * mean, between `entry_size` and `max_size`
+   * 
+   */
+  std::size_t SizeBudget(std::size_t entry_size, std::size_t max_size) const;
+
+  /**
+   * @brief returns false for a share of the crossovers of slow entries,
+   * which grow them most
+   * 
+   */
+  bool AllowCrossover();
+
+  /**
+   * @brief returns true once for each structure much slower than the mean
+   * 
+   */
+  bool Retrim();
+
+  const TimeFit & fit() const {
+    return global;
+  }
+
+private:
+  const TimeFit * entry() const {
+    return current != kNone ? &structures[current].fit : nullptr;
+  }
+
+  /**
+   * @brief returns how many times slower than the mean the current entry
+   * runs, 1 until both fits have enough samples
+   * 
+   */
+  double Slowdown() const;
+};
+
+}
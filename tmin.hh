@@ -0,0 +1,175 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <google/protobuf/message.h>
+
+#include "corpus.hh"
+#include "harness.hh"
+#include "trimming.hh"
+#include "utils.hh"
+
+namespace lpmpp {
+
+static const char * const kTminUsage = 
+  "Usage: %s [-j jobs] [-t timeout] [-n max_steps] [-v] <in_dir> <out_dir>\n"
+  "\n"
+  "Trims every serialized message in in_dir with the lpm++ Trimmer, keeping\n"
+  "only steps which do not change the edge coverage of the linked harness.\n"
+  "\n"
+  "  -j jobs       number of worker processes (default: number of cores)\n"
+  "  -t timeout    timeout of each execution of the harness in seconds\n"
+  "                (default: 10)\n"
+  "  -n max_steps  maximum trimming steps per input (default: 100000)\n"
+  "  -v            keep the output of the harness\n";
+
+
+/**
+ * @brief Runs `proto` through the harness, killing the worker with SIGALRM
+ * if it takes longer than `timeout` seconds, 0 for no timeout
+ * 
+ */
+template<Derived<google::protobuf::Message> T>
+uint64_t RunWithTimeout(Harness<T> &harness, const T &proto, unsigned timeout) {
+  alarm(timeout);
+  const uint64_t signature = harness.Run(proto);
+  alarm(0);
+  return signature;
+}
+
+
+/**
+ * @brief Trims `proto` in-process, reverting any step that changes the
+ * coverage signature of the harness. Each execution of the harness may
+ * take up to `timeout` seconds. Returns the number of executions.
+ * 
+ */
+template<Derived<google::protobuf::Message> T>
+std::size_t TrimMessage(Harness<T> &harness, TrimHistory &history, 
+  const T &proto, std::string &out, std::size_t max_steps, unsigned timeout) {
+
+  const uint64_t signature = RunWithTimeout(harness, proto, timeout);
+
+  auto copy = std::make_unique<T>();
+  copy->CopyFrom(proto);
+  Trimmer trimmer(std::move(copy), &history);
+
+  std::size_t nsteps = 0;
+  while (!trimmer.done() && nsteps++ < max_steps) {
+    trimmer.TrimOne();
+
+    const T &trimmed = static_cast<const T &>(*trimmer.message());
+    if (RunWithTimeout(harness, trimmed, timeout) != signature)
+      trimmer.Revert();
+  }
+
+  uint8_t *buf;
+  std::size_t len = trimmer.Serialize(&buf);
+  out.assign(reinterpret_cast<const char *>(buf), len);
+  return nsteps + 1;
+}
+
+
+/**
+ * @brief Entry point for lpmpp-tmin, trims a corpus directory of serialized
+ * `T` messages across a pool of forked workers.
+ * 
+ * @param argc argument count from main
+ * @param argv arguments from main
+ * @param encoder the post_process encoder used by the campaign, or nullptr
+ */
+template<Derived<google::protobuf::Message> T>
+int TminMain(int argc, char **argv, typename Harness<T>::Encoder encoder) {
+  unsigned jobs = std::thread::hardware_concurrency();
+  unsigned timeout = 10;
+  std::size_t max_steps = 100000;
+  bool verbose = false;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "j:t:n:v")) != -1) {
+    switch (opt) {
+      case 'j': jobs = std::strtoul(optarg, nullptr, 10); break;
+      case 't': timeout = std::strtoul(optarg, nullptr, 10); break;
+      case 'n': max_steps = std::strtoull(optarg, nullptr, 10); break;
+      case 'v': verbose = true; break;
+      default:
+        fprintf(stderr, kTminUsage, argv[0]);
+        return 1;
+    }
+  }
+
+  if (argc - optind != 2) {
+    fprintf(stderr, kTminUsage, argv[0]);
+    return 1;
+  }
+
+  const std::filesystem::path indir(argv[optind]);
+  const std::filesystem::path outdir(argv[optind + 1]);
+  std::filesystem::create_directories(outdir);
+
+  const std::vector<std::filesystem::path> inputs = ListCorpus(indir);
+
+  Harness<T> harness(std::move(encoder));
+  harness.Init(&argc, &argv);
+
+  // Each worker keeps its own trim history across the inputs it processes
+  TrimHistory history;
+  google::protobuf::LogSilencer silencer;
+
+  // The timeout applies to each execution rather than to a whole trim
+  WorkerPool pool(jobs, 0, !verbose);
+  std::vector<std::size_t> failures = pool.Run(inputs.size(), 
+    [&](std::size_t index, unsigned worker) {
+      UNUSED(worker);
+
+      std::string data;
+      std::string out;
+      T proto;
+
+      const std::filesystem::path dst = outdir / inputs[index].filename();
+
+      if (!ReadFile(inputs[index], data))
+        return;
+
+      if (!proto.ParseFromString(data)) {
+        // Unparseable inputs are kept as they are
+        WriteFile(dst, reinterpret_cast<const uint8_t *>(data.data()), data.size());
+        return;
+      }
+
+      TrimMessage(harness, history, proto, out, max_steps, timeout);
+      WriteFile(dst, reinterpret_cast<const uint8_t *>(out.data()), out.size());
+    });
+
+  // Inputs that crash or hang the harness are kept as they are
+
+  for (std::size_t index : failures) {
+    std::cout << "[!] Crashed or timed out: " << inputs[index] << "\n";
+    std::filesystem::copy_file(inputs[index], outdir / inputs[index].filename(),
+                               std::filesystem::copy_options::overwrite_existing);
+  }
+
+  // Summarise the reduction
+
+  std::uintmax_t before = 0;
+  std::uintmax_t after = 0;
+  for (const auto &input : inputs) {
+    const std::filesystem::path dst = outdir / input.filename();
+    before += std::filesystem::file_size(input);
+    if (std::filesystem::exists(dst))
+      after += std::filesystem::file_size(dst);
+  }
+
+  std::cout << "[+] Trimmed " << inputs.size() << " inputs with " 
+            << pool.size() << " workers: " << before << " -> " << after 
+            << " bytes\n";
+
+  return 0;
+}
+
+}
@@ -0,0 +1,76 @@
+// AFL++ bindings for a schema loaded at runtime, see DynamicSchema.
+//
+//   LPMPP_DESCRIPTOR_SET=/path/to/target.desc   (protoc --include_imports --descriptor_set_out)
+//   LPMPP_ROOT_MESSAGE=package.Message
+//
+// Inputs are passed to the target in binary format, so no post_process is 
+// bound.
+
+#include "mutator.hh"
+
+extern "C" {
+
+void *afl_custom_init(afl_state_t *afl, unsigned int seed) {
+  return lpmpp::init_dynamic(afl, seed);
+}
+
+void afl_custom_deinit(lpmpp::MutatorState *state) {
+  return lpmpp::deinit(state);
+}
+
+std::size_t afl_custom_fuzz(lpmpp::MutatorState *state, unsigned char *buf, 
+  std::size_t buf_size, unsigned char **outbuf, unsigned char *addbuf, 
+  std::size_t addbuf_size, std::size_t max_size) {
+  
+  return lpmpp::fuzz(state, buf, buf_size, outbuf, addbuf, addbuf_size, max_size);
+}
+
+int afl_custom_init_trim(lpmpp::MutatorState *state, unsigned char *buf, std::size_t buf_size) {
+  return lpmpp::init_trim(state, buf, buf_size);
+}
+
+std::size_t afl_custom_havoc_mutation(lpmpp::MutatorState *state, unsigned char *buf, 
+  std::size_t buf_size, unsigned char **out_buf, std::size_t max_size) {
+  
+  return lpmpp::havoc_mutation(state, buf, buf_size, out_buf, max_size);
+}
+
+uint8_t afl_custom_havoc_mutation_probability(lpmpp::MutatorState *state) {
+  return lpmpp::havoc_mutation_probability(state);
+}
+
+void afl_custom_splice_optout(lpmpp::MutatorState *state) {
+  lpmpp::splice_optout(state);
+}
+
+std::size_t afl_custom_trim(lpmpp::MutatorState *state, unsigned char **outbuf) {
+  return lpmpp::trim(state, outbuf);
+}
+
+int afl_custom_post_trim(lpmpp::MutatorState *state, unsigned char success) {
+  return lpmpp::post_trim(state, success);
+}
+
+uint8_t afl_custom_queue_new_entry(lpmpp::MutatorState *state, const uint8_t *filename_new, 
+  const uint8_t *filename_orig) {
+  
+  return lpmpp::queue_new_entry(state, filename_new, filename_orig);
+}
+
+uint8_t afl_custom_queue_get(lpmpp::MutatorState *state, const uint8_t *filename) {
+  return lpmpp::queue_get(state, filename);
+}
+
+const char *afl_custom_describe(lpmpp::MutatorState *state, std::size_t max_description_len) {
+  return lpmpp::describe(state, max_description_len);
+}
+
+const char *afl_custom_introspection(lpmpp::MutatorState *state) {
+  return lpmpp::introspection(state);
+}
+
+void afl_custom_post_run(lpmpp::MutatorState *state) {
+  lpmpp::post_run(state);
+}
+
+}
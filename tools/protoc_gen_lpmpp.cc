@@ -0,0 +1,550 @@
+/**
+ * protoc-gen-lpmpp: generates lpm++ MessageTraits specializations for the
+ * messages of a .proto file, so that the mutator can visit known message
+ * types through their generated accessors instead of Reflection. See
+ * visitor.hh.
+ *
+ *   protoc --plugin=protoc-gen-lpmpp=/path/to/protoc-gen-lpmpp \
+ *          --cpp_out=. --lpmpp_out=. file.proto
+ *
+ * Writes file.lpmpp.hh next to file.pb.h. With a root message, also writes
+ * the AFL++ custom mutator bindings for it:
+ *
+ *   --lpmpp_out=root=pkg.Message,encoder=text:.
+ *
+ * The encoder converts messages to the input format of the target in
+ * post_process: binary (none), text (TextFormat) or stream (a user-defined
+ * operator<< on std::stringstream, declared in encoder_header).
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include <google/protobuf/compiler/code_generator.h>
+#include <google/protobuf/compiler/plugin.h>
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/descriptor.pb.h>
+#include <google/protobuf/io/printer.h>
+#include <google/protobuf/io/zero_copy_stream.h>
+
+using namespace google::protobuf;
+
+/* -------------------------------------- */
+/* --- Naming --------------------------- */
+/* -------------------------------------- */
+
+static const std::unordered_set<std::string> kKeywords = {
+  "alignas", "alignof", "and", "and_eq", "asm", "auto", "bitand", "bitor",
+  "bool", "break", "case", "catch", "char", "class", "compl", "const",
+  "constexpr", "const_cast", "continue", "decltype", "default", "delete",
+  "do", "double", "dynamic_cast", "else", "enum", "explicit", "export",
+  "extern", "false", "float", "for", "friend", "goto", "if", "inline", "int",
+  "long", "mutable", "namespace", "new", "noexcept", "not", "not_eq",
+  "nullptr", "operator", "or", "or_eq", "private", "protected", "public",
+  "register", "reinterpret_cast", "return", "short", "signed", "sizeof",
+  "static", "static_assert", "static_cast", "struct", "switch", "template",
+  "this", "thread_local", "throw", "true", "try", "typedef", "typeid",
+  "typename", "union", "unsigned", "using", "virtual", "void", "volatile",
+  "wchar_t", "while", "xor", "xor_eq",
+};
+
+
+static std::string StripProto(const std::string &filename) {
+  for (const char *ext : {".protodevel", ".proto"}) {
+    if (filename.ends_with(ext))
+      return filename.substr(0, filename.size() - strlen(ext));
+  }
+  return filename;
+}
+
+
+/**
+ * @brief returns the fully qualified C++ name of a message or enum, nested
+ * types are reachable through the typedefs in their containing class
+ *
+ */
+static std::string QualifiedName(const std::string &full_name) {
+  std::string name = "::";
+  for (char c : full_name) {
+    if (c == '.')
+      name += "::";
+    else
+      name += c;
+  }
+  return name;
+}
+
+
+/**
+ * @brief returns the name used by the generated accessors of `field`
+ *
+ */
+static std::string FieldName(const FieldDescriptor &field) {
+  std::string name = field.name();
+  std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+
+  if (kKeywords.contains(name))
+    name += "_";
+  return name;
+}
+
+
+static const char * ValueType(const FieldDescriptor &field) {
+  switch (field.cpp_type()) {
+    case FieldDescriptor::CppType::CPPTYPE_INT32: return "int32_t";
+    case FieldDescriptor::CppType::CPPTYPE_INT64: return "int64_t";
+    case FieldDescriptor::CppType::CPPTYPE_UINT32: return "uint32_t";
+    case FieldDescriptor::CppType::CPPTYPE_UINT64: return "uint64_t";
+    case FieldDescriptor::CppType::CPPTYPE_DOUBLE: return "double";
+    case FieldDescriptor::CppType::CPPTYPE_FLOAT: return "float";
+    case FieldDescriptor::CppType::CPPTYPE_BOOL: return "bool";
+    default: return nullptr;
+  }
+}
+
+
+static const char * TypeName(const FieldDescriptor &field) {
+  static const char * const names[] = {
+    nullptr, "TYPE_DOUBLE", "TYPE_FLOAT", "TYPE_INT64", "TYPE_UINT64",
+    "TYPE_INT32", "TYPE_FIXED64", "TYPE_FIXED32", "TYPE_BOOL", "TYPE_STRING",
+    "TYPE_GROUP", "TYPE_MESSAGE", "TYPE_BYTES", "TYPE_UINT32", "TYPE_ENUM",
+    "TYPE_SFIXED32", "TYPE_SFIXED64", "TYPE_SINT32", "TYPE_SINT64",
+  };
+
+  return names[field.type()];
+}
+
+/* -------------------------------------- */
+/* --- Code generation ------------------ */
+/* -------------------------------------- */
+
+static void CollectMessages(const Descriptor &desc, std::vector<const Descriptor *> &out) {
+  if (desc.options().map_entry())
+    return;
+
+  out.push_back(&desc);
+  for (int i = 0; i < desc.nested_type_count(); i++) {
+    CollectMessages(*desc.nested_type(i), out);
+  }
+}
+
+
+/**
+ * @brief Emits the visit of a single field. Singular fields with presence
+ * are only visited when set, so that visiting never changes the message.
+ *
+ */
+static void GenerateVisit(io::Printer &p, const FieldDescriptor &field) {
+  std::map<std::string, std::string> vars;
+  vars["name"] = FieldName(field);
+  vars["index"] = std::to_string(field.index());
+
+  if (field.is_map())
+    return;
+
+  if (field.is_repeated()) {
+    p.Print(vars, "for (int i = 0; i < msg.$name$_size(); i++) {\n");
+  } else if (field.has_presence()) {
+    p.Print(vars, "if (msg.has_$name$()) {\n");
+  } else {
+    p.Print("{\n");
+  }
+  p.Indent();
+
+  const bool rep = field.is_repeated();
+
+  switch (field.cpp_type()) {
+    case FieldDescriptor::CppType::CPPTYPE_STRING:
+      p.Print(vars, rep ? "v.String(Field($index$), *msg.mutable_$name$(i));\n"
+                        : "v.String(Field($index$), *msg.mutable_$name$());\n");
+      break;
+    case FieldDescriptor::CppType::CPPTYPE_MESSAGE:
+      p.Print(vars, rep ? "v.Message(Field($index$), *msg.mutable_$name$(i));\n"
+                        : "v.Message(Field($index$), *msg.mutable_$name$());\n");
+      break;
+    case FieldDescriptor::CppType::CPPTYPE_ENUM:
+      vars["enum"] = QualifiedName(field.enum_type()->full_name());
+      p.Print(vars, rep ? "v.Enum(Field($index$), static_cast<int>(msg.$name$(i)), [&msg, i](int x) {\n"
+                          "  msg.set_$name$(i, static_cast<$enum$>(x));\n"
+                          "});\n"
+                        : "v.Enum(Field($index$), static_cast<int>(msg.$name$()), [&msg](int x) {\n"
+                          "  msg.set_$name$(static_cast<$enum$>(x));\n"
+                          "});\n");
+      break;
+    default:
+      vars["type"] = ValueType(field);
+      p.Print(vars, rep ? "v.Value(Field($index$), msg.$name$(i), [&msg, i]($type$ x) {\n"
+                          "  msg.set_$name$(i, x);\n"
+                          "});\n"
+                        : "v.Value(Field($index$), msg.$name$(), [&msg]($type$ x) {\n"
+                          "  msg.set_$name$(x);\n"
+                          "});\n");
+      break;
+  }
+
+  p.Outdent();
+  p.Print("}\n");
+}
+
+
+static void GenerateTraits(io::Printer &p, const Descriptor &desc) {
+  std::map<std::string, std::string> vars;
+  vars["class"] = QualifiedName(desc.full_name());
+  vars["count"] = std::to_string(desc.field_count());
+
+  p.Print(vars,
+    "template<>\n"
+    "struct MessageTraits<$class$> {\n");
+  p.Indent();
+
+  p.Print(vars,
+    "static constexpr bool kSpecialized = true;\n"
+    "static constexpr int kFieldCount = $count$;\n"
+    "static constexpr std::array<FieldLayout, $count$> kFields = {{\n");
+  p.Indent();
+
+  for (int i = 0; i < desc.field_count(); i++) {
+    const FieldDescriptor &field = *desc.field(i);
+    const OneofDescriptor *oneof = field.containing_oneof();
+
+    p.Print("{$number$, ::google::protobuf::FieldDescriptor::$type$, $repeated$, $oneof$},\n",
+            "number", std::to_string(field.number()),
+            "type", TypeName(field),
+            "repeated", field.is_repeated() ? "true" : "false",
+            "oneof", oneof ? std::to_string(oneof->index()) : "-1");
+  }
+
+  p.Outdent();
+  p.Print(vars,
+    "}};\n"
+    "\n"
+    "static const ::google::protobuf::FieldDescriptor * Field(int index) {\n"
+    "  static const ::google::protobuf::Descriptor *desc = $class$::descriptor();\n"
+    "  return desc->field(index);\n"
+    "}\n"
+    "\n"
+    "template<typename V>\n"
+    "static void Visit($class$ &msg, V &v) {\n");
+  p.Indent();
+
+  if (desc.field_count() == 0)
+    p.Print("(void)msg;\n(void)v;\n");
+
+  for (int i = 0; i < desc.field_count(); i++) {
+    GenerateVisit(p, *desc.field(i));
+  }
+
+  p.Outdent();
+  p.Print("}\n");
+  p.Outdent();
+  p.Print("};\n\n");
+}
+
+
+/**
+ * @brief Generator parameters, passed as --lpmpp_out=key=value,...:outdir
+ *
+ */
+struct Options {
+  // Full name of the root message, enables the bindings
+  std::string root;
+  // binary, text or stream
+  std::string encoder = "binary";
+  // Header declaring operator<< for the stream encoder
+  std::string encoder_header;
+  // Prefix of the generated headers in the include path of the bindings
+  std::string include_prefix;
+  // Base name of the bindings, <file>_mutator by default
+  std::string name;
+  // Whether to write <file>.lpmpp.hh
+  bool traits = true;
+};
+
+
+static bool ParseOptions(const std::string &parameter, Options &options, std::string *error) {
+  std::vector<std::pair<std::string, std::string>> params;
+  compiler::ParseGeneratorParameter(parameter, &params);
+
+  for (const auto &[key, value] : params) {
+    if (key == "root") {
+      options.root = value;
+    } else if (key == "encoder") {
+      options.encoder = value;
+    } else if (key == "encoder_header") {
+      options.encoder_header = value;
+    } else if (key == "include_prefix") {
+      options.include_prefix = value;
+    } else if (key == "name") {
+      options.name = value;
+    } else if (key == "traits") {
+      options.traits = value != "false";
+    } else {
+      *error = "unknown parameter: " + key;
+      return false;
+    }
+  }
+
+  if (options.encoder != "binary" && options.encoder != "text" && options.encoder != "stream") {
+    *error = "unknown encoder: " + options.encoder + ", expected binary, text or stream";
+    return false;
+  }
+
+  return true;
+}
+
+
+static bool GenerateTraitsHeader(const FileDescriptor &file, compiler::GeneratorContext &context, 
+                                 std::string *error) {
+
+  const std::string basename = StripProto(file.name());
+  std::unique_ptr<io::ZeroCopyOutputStream> output(context.Open(basename + ".lpmpp.hh"));
+  io::Printer p(output.get(), '$');
+
+  p.Print(
+    "// Generated by protoc-gen-lpmpp.  DO NOT EDIT!\n"
+    "// source: $source$\n"
+    "\n"
+    "#pragma once\n"
+    "\n"
+    "#include <array>\n"
+    "#include <cstdint>\n"
+    "#include <google/protobuf/descriptor.h>\n"
+    "\n"
+    "#include \"$basename$.pb.h\"\n",
+    "source", file.name(),
+    "basename", basename);
+
+  // Traits of imported messages come from their own generated headers,
+  // well-known types have none and are skipped by visitors
+
+  for (int i = 0; i < file.dependency_count(); i++) {
+    const std::string &dep = file.dependency(i)->name();
+    if (!dep.starts_with("google/protobuf/"))
+      p.Print("#include \"$dep$.lpmpp.hh\"\n", "dep", StripProto(dep));
+  }
+
+  p.Print(
+    "#include \"visitor.hh\"\n"
+    "\n"
+    "namespace lpmpp {\n"
+    "\n");
+
+  std::vector<const Descriptor *> messages;
+  for (int i = 0; i < file.message_type_count(); i++) {
+    CollectMessages(*file.message_type(i), messages);
+  }
+
+  for (const Descriptor *desc : messages) {
+    GenerateTraits(p, *desc);
+  }
+
+  p.Print("}\n");
+
+  if (p.failed()) {
+    *error = "failed to write " + basename + ".lpmpp.hh";
+    return false;
+  }
+
+  return true;
+}
+
+
+/**
+ * @brief Emits the AFL++ custom mutator translation unit for `root`, every
+ * hook forwards to lpm++ with the root type
+ *
+ */
+static bool GenerateBindings(const FileDescriptor &file, const Descriptor &root, 
+                             const Options &options, compiler::GeneratorContext &context, 
+                             std::string *error) {
+
+  const std::string basename = StripProto(file.name());
+  const std::string name = options.name.empty() ? basename + "_mutator" : options.name;
+
+  std::map<std::string, std::string> vars;
+  vars["source"] = file.name();
+  vars["root"] = root.full_name();
+  vars["class"] = QualifiedName(root.full_name());
+  vars["encoder"] = options.encoder;
+  vars["header"] = options.include_prefix + basename + ".lpmpp.hh";
+  vars["name"] = name;
+
+  {
+    std::unique_ptr<io::ZeroCopyOutputStream> output(context.Open(name + ".cc"));
+    io::Printer p(output.get(), '$');
+
+    p.Print(vars,
+      "// Generated by protoc-gen-lpmpp.  DO NOT EDIT!\n"
+      "// source: $source$, root: $root$, encoder: $encoder$\n"
+      "\n"
+      "#include <string>\n");
+
+    if (options.encoder == "stream")
+      p.Print("#include <sstream>\n");
+    if (options.encoder == "text")
+      p.Print("#include <google/protobuf/text_format.h>\n");
+
+    p.Print(vars,
+      "\n"
+      "#include \"mutator.hh\"\n"
+      "#include \"$header$\"\n");
+
+    if (!options.encoder_header.empty())
+      p.Print("#include \"$h$\"\n", "h", options.encoder_header);
+
+    p.Print(vars,
+      "\n"
+      "using Root = $class$;\n"
+      "\n");
+
+    if (options.encoder == "stream") {
+      p.Print(
+        "static void Encode(const Root &proto, std::string &out) {\n"
+        "  std::stringstream stream;\n"
+        "  stream << proto;\n"
+        "  out = stream.str();\n"
+        "}\n"
+        "\n");
+    } else if (options.encoder == "text") {
+      p.Print(
+        "static void Encode(const Root &proto, std::string &out) {\n"
+        "  google::protobuf::TextFormat::PrintToString(proto, &out);\n"
+        "}\n"
+        "\n");
+    }
+
+    p.Print(
+      "extern \"C\" {\n"
+      "\n"
+      "void *afl_custom_init(afl_state_t *afl, unsigned int seed) {\n"
+      "  return lpmpp::init(afl, seed);\n"
+      "}\n"
+      "\n"
+      "void afl_custom_deinit(lpmpp::MutatorState *state) {\n"
+      "  return lpmpp::deinit(state);\n"
+      "}\n"
+      "\n"
+      "std::size_t afl_custom_fuzz(lpmpp::MutatorState *state, unsigned char *buf, \n"
+      "  std::size_t buf_size, unsigned char **outbuf, unsigned char *addbuf, \n"
+      "  std::size_t addbuf_size, std::size_t max_size) {\n"
+      "  \n"
+      "  return lpmpp::fuzz<Root>(state, buf, buf_size, outbuf, addbuf, addbuf_size, max_size);\n"
+      "}\n"
+      "\n"
+      "int afl_custom_init_trim(lpmpp::MutatorState *state, unsigned char *buf, std::size_t buf_size) {\n"
+      "  return lpmpp::init_trim<Root>(state, buf, buf_size);\n"
+      "}\n"
+      "\n"
+      "std::size_t afl_custom_havoc_mutation(lpmpp::MutatorState *state, unsigned char *buf, \n"
+      "  std::size_t buf_size, unsigned char **out_buf, std::size_t max_size) {\n"
+      "  \n"
+      "  return lpmpp::havoc_mutation<Root>(state, buf, buf_size, out_buf, max_size);\n"
+      "}\n"
+      "\n"
+      "uint8_t afl_custom_havoc_mutation_probability(lpmpp::MutatorState *state) {\n"
+      "  return lpmpp::havoc_mutation_probability(state);\n"
+      "}\n"
+      "\n"
+      "void afl_custom_splice_optout(lpmpp::MutatorState *state) {\n"
+      "  lpmpp::splice_optout(state);\n"
+      "}\n"
+      "\n"
+      "std::size_t afl_custom_trim(lpmpp::MutatorState *state, unsigned char **outbuf) {\n"
+      "  return lpmpp::trim(state, outbuf);\n"
+      "}\n"
+      "\n"
+      "int afl_custom_post_trim(lpmpp::MutatorState *state, unsigned char success) {\n"
+      "  return lpmpp::post_trim(state, success);\n"
+      "}\n"
+      "\n"
+      "uint8_t afl_custom_queue_new_entry(lpmpp::MutatorState *state, const uint8_t *filename_new, \n"
+      "  const uint8_t *filename_orig) {\n"
+      "  \n"
+      "  return lpmpp::queue_new_entry<Root>(state, filename_new, filename_orig);\n"
+      "}\n"
+      "\n"
+      "uint8_t afl_custom_queue_get(lpmpp::MutatorState *state, const uint8_t *filename) {\n"
+      "  return lpmpp::queue_get<Root>(state, filename);\n"
+      "}\n"
+      "\n"
+      "const char *afl_custom_describe(lpmpp::MutatorState *state, std::size_t max_description_len) {\n"
+      "  return lpmpp::describe(state, max_description_len);\n"
+      "}\n"
+      "\n"
+      "const char *afl_custom_introspection(lpmpp::MutatorState *state) {\n"
+      "  return lpmpp::introspection(state);\n"
+      "}\n"
+      "\n"
+      "void afl_custom_post_run(lpmpp::MutatorState *state) {\n"
+      "  lpmpp::post_run(state);\n"
+      "}\n");
+
+    // The binary encoder feeds the serialized message to the target as is
+    if (options.encoder != "binary") {
+      p.Print(
+        "\n"
+        "std::size_t afl_custom_post_process(lpmpp::MutatorState *state, unsigned char *buf, \n"
+        "  std::size_t buf_size, unsigned char **outbuf) {\n"
+        "  \n"
+        "  return lpmpp::post_process<Root>(state, buf, buf_size, outbuf, Encode);\n"
+        "}\n");
+    }
+
+    p.Print(
+      "\n"
+      "}\n");
+
+    if (p.failed()) {
+      *error = "failed to write " + name + ".cc";
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+class LpmppGenerator : public compiler::CodeGenerator {
+public:
+  bool Generate(const FileDescriptor *file, const std::string &parameter,
+                compiler::GeneratorContext *context, std::string *error) const override {
+
+    Options options;
+    if (!ParseOptions(parameter, options, error))
+      return false;
+
+    if (file->options().optimize_for() == FileOptions::LITE_RUNTIME) {
+      *error = file->name() + ": lite runtime messages have no descriptors";
+      return false;
+    }
+
+    if (options.traits && !GenerateTraitsHeader(*file, *context, error))
+      return false;
+
+    if (options.root.empty())
+      return true;
+
+    // Bindings are written with the file that defines the root message
+
+    const Descriptor *root = file->pool()->FindMessageTypeByName(options.root);
+    if (!root) {
+      *error = "root message not found: " + options.root;
+      return false;
+    }
+
+    if (root->file() != file)
+      return true;
+
+    return GenerateBindings(*file, *root, options, *context, error);
+  }
+};
+
+
+int main(int argc, char **argv) {
+  LpmppGenerator generator;
+  return compiler::PluginMain(argc, argv, &generator);
+}
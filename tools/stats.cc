@@ -0,0 +1,112 @@
+/**
+ * lpmpp-stats: aggregates the shared memory stats of every lpm++ instance
+ * running on the host. Requires the mutator to be built with 
+ * MUTATOR_TRACK_STATS.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <unistd.h>
+
+#include "statistics.hh"
+
+using namespace lpmpp;
+
+static const char * const kUsage = 
+  "Usage: %s [-i interval] [-1]\n"
+  "\n"
+  "  -i interval  seconds between updates (default: 5)\n"
+  "  -1           print once and exit\n";
+
+
+static void Print() {
+  std::vector<StatsView> views = StatsView::OpenAll();
+  uint64_t totals[NUM_COUNTERS] = {};
+
+  printf("%-8s %-16s %-6s", "pid", "name", "alive");
+  for (int c = 0; c < NUM_COUNTERS; c++) {
+    printf(" %16s", StatsCounterDesc[c]);
+  }
+  printf("\n");
+
+  for (const StatsView &view : views) {
+    const StatsSegment &segment = view.segment_data();
+
+    printf("%-8d %-16.16s %-6s", segment.pid, segment.name, view.alive() ? "yes" : "no");
+    for (int c = 0; c < NUM_COUNTERS; c++) {
+      const uint64_t value = segment.counters[c].load();
+      totals[c] += value;
+      printf(" %16lu", value);
+    }
+    printf("\n");
+  }
+
+  printf("%-8s %-16s %-6s", "total", "", "");
+  for (int c = 0; c < NUM_COUNTERS; c++) {
+    printf(" %16lu", totals[c]);
+  }
+  printf("\n\n");
+
+  // Latency percentiles across all instances, in nanoseconds
+
+  printf("%-16s %12s %10s %10s %10s %10s\n", "phase", "count", "p50", "p90", "p99", "p99.9");
+  for (int p = 0; p < NUM_PHASES; p++) {
+    LatencySummary summary;
+    for (const StatsView &view : views) {
+      summary.add(view.segment_data().latencies[p]);
+    }
+
+    printf("%-16s %12lu %10lu %10lu %10lu %10lu\n", StatsPhaseDesc[p], summary.count(),
+           summary.percentile(50), summary.percentile(90), summary.percentile(99), 
+           summary.percentile(99.9));
+  }
+  printf("\n");
+
+  // Mutation operators across all instances, latencies in nanoseconds
+
+  printf("%-16s %12s %12s %10s %10s %10s\n", "operator", "chosen", "yields", "yield/1M",
+         "p50", "p99");
+  for (int op = 0; op < NUM_OPS; op++) {
+    uint64_t chosen = 0;
+    uint64_t yields = 0;
+    LatencySummary summary;
+    for (const StatsView &view : views) {
+      chosen += view.segment_data().op_chosen[op].load();
+      yields += view.segment_data().op_yields[op].load();
+      summary.add(view.segment_data().op_latencies[op]);
+    }
+
+    printf("%-16s %12lu %12lu %10.1f %10lu %10lu\n", MutationOpDesc[op], chosen, yields, 
+           chosen ? 1e6 * yields / chosen : 0.0, summary.percentile(50), 
+           summary.percentile(99));
+  }
+  printf("\n");
+  fflush(stdout);
+}
+
+
+int main(int argc, char **argv) {
+  unsigned interval = 5;
+  bool once = false;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "i:1")) != -1) {
+    switch (opt) {
+      case 'i': interval = std::strtoul(optarg, nullptr, 10); break;
+      case '1': once = true; break;
+      default:
+        fprintf(stderr, kUsage, argv[0]);
+        return 1;
+    }
+  }
+
+  do {
+    Print();
+    if (!once)
+      std::this_thread::sleep_for(std::chrono::seconds(interval));
+  } while (!once);
+
+  return 0;
+}
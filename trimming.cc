@@ -2,6 +2,7 @@
 #include <cstdlib>
 #include <sstream>
 #include <algorithm>
+#include <cstring>
 #include <google/protobuf/unknown_field_set.h>
 
 #include "trimming.hh"
@@ -37,6 +38,48 @@ static std::string GetID(const std::string &rootpath, const FieldDescriptor &fie
 }
 
 
+static const char * const kBulkPath = "NODES.*";
+static const char kChunkDelimiters[] = " \t\r\n,;:=&/.\"'";
+
+
+/**
+ * @brief Returns the serialized form of element `i` of the repeated `field`
+ * 
+ */
+static std::string ElementKey(const Message &msg, const FieldDescriptor &field, int i) {
+  const Reflection &reflection = *msg.GetReflection();
+
+  auto raw = [](auto value) {
+    return std::string(reinterpret_cast<const char *>(&value), sizeof(value));
+  };
+
+  switch (field.cpp_type()) {
+    case FieldDescriptor::CppType::CPPTYPE_INT32:
+      return raw(reflection.GetRepeatedInt32(msg, &field, i));
+    case FieldDescriptor::CppType::CPPTYPE_INT64:
+      return raw(reflection.GetRepeatedInt64(msg, &field, i));
+    case FieldDescriptor::CppType::CPPTYPE_UINT32:
+      return raw(reflection.GetRepeatedUInt32(msg, &field, i));
+    case FieldDescriptor::CppType::CPPTYPE_UINT64:
+      return raw(reflection.GetRepeatedUInt64(msg, &field, i));
+    case FieldDescriptor::CppType::CPPTYPE_DOUBLE:
+      return raw(reflection.GetRepeatedDouble(msg, &field, i));
+    case FieldDescriptor::CppType::CPPTYPE_FLOAT:
+      return raw(reflection.GetRepeatedFloat(msg, &field, i));
+    case FieldDescriptor::CppType::CPPTYPE_BOOL:
+      return raw(reflection.GetRepeatedBool(msg, &field, i));
+    case FieldDescriptor::CppType::CPPTYPE_ENUM:
+      return raw(reflection.GetRepeatedEnumValue(msg, &field, i));
+    case FieldDescriptor::CppType::CPPTYPE_STRING:
+      return reflection.GetRepeatedString(msg, &field, i);
+    case FieldDescriptor::CppType::CPPTYPE_MESSAGE:
+      return reflection.GetRepeatedMessage(msg, &field, i).SerializeAsString();
+  }
+
+  __builtin_unreachable();
+}
+
+
 static std::string& TruncateString(std::string &str) {
   // Simplified logic from AFL++
 
@@ -49,6 +92,33 @@ static std::string& TruncateString(std::string &str) {
 }
 
 
+/**
+ * @brief Returns the end of the chunk of length `chunk` starting at `pos`. 
+ * The end is moved to just after the delimiter nearest to `pos + chunk` if
+ * one exists within half a chunk either side.
+ * 
+ */
+static std::size_t AlignChunk(const std::string &str, std::size_t pos, std::size_t chunk) {
+  const std::size_t target = std::min(pos + chunk, str.size());
+  const std::size_t window = chunk / 2;
+
+  if (window == 0)
+    return target;
+
+  // The chunk never ends at or before pos
+  for (std::size_t d = 0; d <= window; d++) {
+    if (target + d <= str.size() && target + d > pos && 
+        strchr(kChunkDelimiters, str[target + d - 1]))
+      return target + d;
+
+    if (d < target - pos && strchr(kChunkDelimiters, str[target - d - 1]))
+      return target - d;
+  }
+
+  return target;
+}
+
+
 /**
  * @brief Trim nodes first, then strings. Avoids unnecessary trimming
  * against nodes that do not generate interesting coverage. Downside
@@ -61,6 +131,8 @@ static TrimType NextTrimType(TrimType type) {
     case NODES:
       return STRINGS;
     case STRINGS:
+      return CHUNKS;
+    case CHUNKS:
       return NONE;
     case NONE:
       return NONE;
@@ -70,26 +142,15 @@ static TrimType NextTrimType(TrimType type) {
 }
 
 
-static bool ShouldTrim(const TrimType type, const FieldDescriptor &field) {
-  switch(type) {
-    case STRINGS:
-      return StringTrimTask::CanHandle(field);
-    case NODES:
-      return NodeTrimTask::CanHandle(field);
-    case NONE:
-      return false;
-  }
-
-  __builtin_unreachable();
-}
-
-
 static std::shared_ptr<TrimTask> MakeTrimTask(const TrimType type, Message &msg, 
-  const FieldDescriptor &field, std::string path, int rindex) {
+  const FieldDescriptor &field, std::string path, int rindex, 
+  std::unordered_map<std::string, ChunkTrimTask::Cursor> &cursors) {
 
   switch(type) {
     case STRINGS:
       return std::make_shared<StringTrimTask>(msg, field, path, rindex);
+    case CHUNKS:
+      return std::make_shared<ChunkTrimTask>(msg, field, path, rindex, cursors[path]);
     case NODES:
       return std::make_shared<NodeTrimTask>(msg, field, path, rindex);
     case NONE:
@@ -141,13 +202,105 @@ void NodeTrimTask::Trim() {
   } while (true);
 }
 
+bool ChunkTrimTask::done() {
+  if (cursor.nsteps > kMaxStrSteps)
+    return true;
+
+  // Assumes the last chunk was kept, if it is reverted Reject() advances
+  // the cursor past the chunk instead
+
+  return cursor.chunk <= 1 && cursor.pos >= string().size();
+}
+
+void ChunkTrimTask::Trim() {
+  std::string str = string();
+
+  // Start with the largest chunks, halve the chunk size after each pass 
+
+  if (cursor.chunk == 0)
+    cursor.chunk = std::max(NextPow2(std::max(str.size(), (std::size_t) 2)) / 2, 
+                            (std::size_t) 1);
+
+  while (cursor.pos >= str.size() && cursor.chunk > 1) {
+    cursor.chunk /= 2;
+    cursor.pos = 0;
+  }
+
+  cursor.nsteps++;
+  cursor.removed = 0;
+
+  if (cursor.pos >= str.size())
+    return;
+
+  // The chunk may be larger than what is left, e.g. at the tail or after
+  // the string shrank. The cursor keeps its size for the next pass.
+  const std::size_t chunk = std::min(cursor.chunk, str.size() - cursor.pos);
+  const std::size_t end = AlignChunk(str, cursor.pos, chunk);
+  cursor.removed = end - cursor.pos;
+  str.erase(cursor.pos, cursor.removed);
+  set_string(str);
+}
+
+void ChunkTrimTask::Reject() {
+  cursor.pos += cursor.removed;
+  cursor.removed = 0;
+}
+
+bool DedupTrimTask::HasDuplicates(const Message &msg, const FieldDescriptor &field) {
+  const int n = msg.GetReflection()->FieldSize(msg, &field);
+  if (n < 2)
+    return false;
+
+  std::unordered_set<std::string> seen;
+  for (int i = 0; i < n; i++) {
+    if (!seen.insert(ElementKey(msg, field, i)).second)
+      return true;
+  }
+
+  return false;
+}
+
+void DedupTrimTask::Trim() {
+  const Reflection &reflection = *msg.GetReflection();
+  const int n = reflection.FieldSize(msg, &field);
+
+  // Move the first occurrence of each element to the front, preserving
+  // order, then drop everything after it
+
+  std::unordered_set<std::string> seen;
+  int nkeep = 0;
+
+  for (int i = 0; i < n; i++) {
+    if (!seen.insert(ElementKey(msg, field, i)).second)
+      continue;
+    
+    if (i != nkeep)
+      reflection.SwapElements(&msg, &field, i, nkeep);
+    nkeep++;
+  }
+
+  while (reflection.FieldSize(msg, &field) > nkeep) {
+    reflection.RemoveLast(&msg, &field);
+  }
+}
+
+void BulkTrimTask::Trim() {
+  for (auto it = targets.rbegin(); it != targets.rend(); ++it) {
+    it->first->GetReflection()->ClearField(it->first, it->second);
+  }
+}
+
 /* -------------------------------------- */
 /* --- Trimmer method definitions ------- */
 /* -------------------------------------- */
 
-Trimmer::Trimmer(std::unique_ptr<Message> message) : 
+Trimmer::Trimmer(std::unique_ptr<Message> message, TrimHistory *history) : 
     msg(std::move(message)), 
-    pmsg(msg->New()) {
+    pmsg(msg->New()),
+    history(history) {
+
+  if (history)
+    history->BeginSession();
 
   buf.resize(0x1000);
   pmsg->CopyFrom(*msg);
@@ -155,6 +308,13 @@ Trimmer::Trimmer(std::unique_ptr<Message> message) :
 }
 
 
+Trimmer::~Trimmer() {
+  // The last step is kept unless it was reverted
+  if (last && history)
+    last->Record(*history, true);
+}
+
+
 void Trimmer::PopulateTasks() {
   if (trim_type_ == TrimType::NONE) {
     return;
@@ -173,20 +333,42 @@ void Trimmer::PopulateTasks() {
     Message &nmsg = messages.top().second;
     messages.pop();
 
-    const Reflection *reflection = nmsg.GetReflection();
-    std::vector<const FieldDescriptor *> descs;
-    reflection->ListFields(nmsg, &descs);
+    const Reflection &reflection = *nmsg.GetReflection();
+    const FieldTable &table = GetFieldTable(nmsg);
+
+    for (const FieldEntry &entry : table.fields) {
+      if (!IsSet(nmsg, reflection, entry))
+        continue;
 
-    for (const FieldDescriptor *desc : descs) {
       const FieldInfo info {
         .rootpath = rootpath,
         .msg = nmsg,
-        .field = *desc
+        .field = *entry.field,
+        .entry = entry
       };
 
       CreateTask(messages, info);
     }
   }
+
+  // Duplicate elements are removed together before any other task in the
+  // trim session. Fields that are usually redundant are removed first. The
+  // individual tasks remain as a fallback.
+
+  for (auto &task : dedups) {
+    tasks.push(std::move(task));
+  }
+  dedups.clear();
+
+  if (!bulk.empty()) {
+    tasks.push(std::make_shared<BulkTrimTask>(std::move(bulk), kBulkPath));
+    bulk.clear();
+  }
+}
+
+
+bool Trimmer::ShouldCreateNodeTask(const FieldDescriptor &field) {
+  return !history || !history->ShouldSkip(field);
 }
 
 
@@ -198,19 +380,29 @@ void Trimmer::CreateTask(MessageStack &accumulator, const FieldInfo &info) {
   // the field is a Message, add to the MessageStack. We skip fields and all
   // of its descendants if the field has already been processed.
 
-  if (!desc.is_repeated()) {
+  const FieldEntry &entry = info.entry;
+  bool should_trim = trim_type_ != TrimType::NONE && entry.trimmable(trim_type_);
+
+  if (should_trim && trim_type_ == TrimType::NODES) {
+    should_trim = ShouldCreateNodeTask(desc);
+
+    if (history && !processed.contains(kBulkPath) && history->IsRedundant(desc))
+      bulk.push_back(BulkTrimTask::Target(&info.msg, &desc));
+  }
+
+  if (!entry.repeated) {
     std::string path(GetID(info.rootpath, desc, -1));
     if (processed.contains(path)) {
       return;
     }
 
-    if (desc.cpp_type() == FieldDescriptor::CppType::CPPTYPE_MESSAGE) {
+    if (entry.message) {
       Message &m = *reflection->MutableMessage(&info.msg, &desc);
       accumulator.push(MessageStackE(path, m));
     }
 
-    if (ShouldTrim(trim_type_, desc)) {
-      tasks.push(MakeTrimTask(trim_type_, info.msg, desc, path, -1));
+    if (should_trim) {
+      tasks.push(MakeTrimTask(trim_type_, info.msg, desc, path, -1, cursors));
     }
     
     return;
@@ -218,25 +410,51 @@ void Trimmer::CreateTask(MessageStack &accumulator, const FieldInfo &info) {
 
   // For repeated fields, create a TrimTask for each entry in the field.
 
-  for (int i = 0; i < reflection->FieldSize(info.msg, &desc); i++) {
+  if (trim_type_ == TrimType::NODES) {
+    std::string path(GetID(info.rootpath, desc, -1) + "[=]");
+
+    if (!processed.contains(path) && DedupTrimTask::HasDuplicates(info.msg, desc))
+      dedups.push_back(std::make_shared<DedupTrimTask>(info.msg, desc, path));
+  }
+
+  const int n = reflection->FieldSize(info.msg, &desc);
+  for (int i = 0; i < n; i++) {
     std::string path(GetID(info.rootpath, desc, i));
     if (processed.contains(path)) {
       return;
     }
 
-    if (desc.cpp_type() == FieldDescriptor::CppType::CPPTYPE_MESSAGE)  {
+    if (entry.message)  {
       Message &m = *reflection->MutableRepeatedMessage(&info.msg, &desc, i);
       accumulator.push(MessageStackE(path, m));
     }
 
-    if (ShouldTrim(trim_type_, desc)) {
-      tasks.push(MakeTrimTask(trim_type_, info.msg, desc, path, i));
+    if (should_trim) {
+      tasks.push(MakeTrimTask(trim_type_, info.msg, desc, path, i, cursors));
     }
   }
 }
 
 
+void Trimmer::Settle() {
+  if (!last)
+    return;
+
+  if (history)
+    last->Record(*history, true);
+
+  if (last->restructures()) {
+    tasks = std::stack<std::shared_ptr<TrimTask>>();
+    PopulateTasks();
+  }
+
+  last.reset();
+}
+
+
 void Trimmer::TrimOne() {
+  Settle();
+
   if (tasks.empty()) {
     trim_type_ = NextTrimType(trim_type_);
     PopulateTasks();
@@ -251,9 +469,11 @@ void Trimmer::TrimOne() {
   auto task = tasks.top();
   task->set_started(true);
   task->Trim();
+  last = task;
 
   // Keep track of processed paths for reverts
-  processed.insert(task->path());
+  if (!task->resumable() || task->done())
+    processed.insert(task->path());
   
   if (task->done())
     tasks.pop();
@@ -264,6 +484,14 @@ void Trimmer::Revert() {
   // Revert root message to the last state
   msg->CopyFrom(*pmsg);
 
+  if (last) {
+    last->Reject();
+
+    if (history)
+      last->Record(*history, false);
+  }
+  last.reset();
+
   if (tasks.empty())
     trim_type_ = NextTrimType(trim_type_);
 
@@ -4,7 +4,10 @@
 #include <stack>
 #include <exception>
 #include <cstddef>
+#include <cstdint>
 #include <cstdlib>
+#include <unordered_map>
+#include <unordered_set>
 
 #include <google/protobuf/any.pb.h>
 #include <google/protobuf/descriptor.pb.h>
@@ -13,21 +16,98 @@
 #include <google/protobuf/util/message_differencer.h>
 #include <google/protobuf/wire_format.h>
 
+#include "fieldtable.hh"
+#include "utils.hh"
+
 namespace lpmpp {
 
 enum TrimType {
   NODES,
   STRINGS, 
+  CHUNKS,
   NONE,
 };
 
 const char * const TrimTypeDesc[] = {
   "NODES",
   "STRINGS",
+  "CHUNKS",
   "NONE",
 };
 
 
+/**
+ * @brief Outcomes of node trimming for each field, accumulated across all 
+ * trim sessions. Fields which can usually be removed are trimmed in bulk at
+ * the start of a session, fields which are always necessary are skipped.
+ * 
+ */
+class TrimHistory {
+public:
+  // Minimum number of attempts before a field is classified
+  static constexpr uint32_t kMinSamples = 32;
+  // Percentage of successful removals for a field to be trimmed in bulk
+  static constexpr uint32_t kRedundantPct = 90;
+  // Fields that are always necessary are still re-tested every N sessions
+  static constexpr uint32_t kReprobeInterval = 16;
+
+private:
+  struct Counts {
+    uint32_t attempts = 0;
+    uint32_t successes = 0;
+  };
+
+  std::unordered_map<const google::protobuf::FieldDescriptor *, Counts> records;
+  uint64_t sessions = 0;
+
+public:
+  /**
+   * @brief Called by the Trimmer at the start of every trim session
+   * 
+   */
+  void BeginSession() {
+    sessions++;
+  }
+
+  /**
+   * @brief Record the outcome of removing `field`
+   * 
+   * @param field the descriptor of the removed field
+   * @param success true if the removal did not change coverage
+   */
+  void Record(const google::protobuf::FieldDescriptor &field, bool success) {
+    Counts &r = records[&field];
+    r.attempts++;
+    r.successes += success ? 1 : 0;
+  }
+
+  /**
+   * @brief returns true if removing `field` rarely changes coverage
+   * 
+   */
+  bool IsRedundant(const google::protobuf::FieldDescriptor &field) const {
+    auto it = records.find(&field);
+    if (it == records.end() || it->second.attempts < kMinSamples)
+      return false;
+
+    return it->second.successes * 100 >= it->second.attempts * kRedundantPct;
+  }
+
+  /**
+   * @brief returns true if `field` has never been removed successfully and
+   * should not be tested in the current session
+   * 
+   */
+  bool ShouldSkip(const google::protobuf::FieldDescriptor &field) const {
+    auto it = records.find(&field);
+    if (it == records.end() || it->second.attempts < kMinSamples)
+      return false;
+
+    return it->second.successes == 0 && sessions % kReprobeInterval != 0;
+  }
+};
+
+
 class TrimTask {
 protected:
   google::protobuf::Message &msg;
@@ -83,11 +163,46 @@ public:
     return true;
   }
 
+  /**
+   * @brief returns true if a successful Trim() invalidates the paths of
+   * other pending tasks
+   * 
+   */
+  virtual bool restructures() const {
+    return false;
+  }
+
+  /**
+   * @brief returns true if the task keeps its progress across reverts, in
+   * which case its path is only marked as processed once it is done
+   * 
+   */
+  virtual bool resumable() const {
+    return false;
+  }
+
   /**
    * @brief Trims the field
    */
   virtual void Trim() = 0;
 
+  /**
+   * @brief Called when the last Trim() is reverted
+   * 
+   */
+  virtual void Reject() {}
+
+  /**
+   * @brief Records the outcome of the last Trim() in `history`
+   * 
+   * @param history the trim history shared across sessions
+   * @param success true if the trimmed message was kept
+   */
+  virtual void Record(TrimHistory &history, bool success) {
+    UNUSED(history);
+    UNUSED(success);
+  }
+
 };
 
 
@@ -113,7 +228,7 @@ public:
   void Trim() override;
   bool done() override;
 
-private:
+protected:
   std::string string() const {
     const google::protobuf::Reflection &reflection = *msg.GetReflection();
 
@@ -135,6 +250,48 @@ private:
 };
 
 
+/**
+ * @brief Remove chunks from any position of bytes fields using delta 
+ * debugging. Chunk boundaries are aligned to common delimiters where
+ * possible. Progress is kept in a Cursor owned by the Trimmer, since
+ * tasks are recreated after every revert.
+ * 
+ */
+class ChunkTrimTask : public StringTrimTask {
+public:
+  struct Cursor {
+    std::size_t chunk = 0;
+    std::size_t pos = 0;
+    std::size_t removed = 0;
+    int nsteps = 0;
+  };
+
+private:
+  Cursor &cursor;
+
+public:
+  static bool CanHandle(const google::protobuf::FieldDescriptor &field) {
+    return field.type() == google::protobuf::FieldDescriptor::Type::TYPE_BYTES;
+  }
+
+  ChunkTrimTask(google::protobuf::Message &msg,
+                const google::protobuf::FieldDescriptor &field, 
+                std::string path, 
+                int rindex,
+                Cursor &cursor) :
+    StringTrimTask(msg, field, path, rindex),
+    cursor(cursor) {}
+
+  bool resumable() const override {
+    return true;
+  }
+
+  void Trim() override;
+  bool done() override;
+  void Reject() override;
+};
+
+
 /**
  * @brief Remove optional nodes
  * 
@@ -152,6 +309,79 @@ public:
     TrimTask(msg, field, path, rindex) {}
 
   void Trim() override;
+
+  void Record(TrimHistory &history, bool success) override {
+    history.Record(field, success);
+  }
+};
+
+
+/**
+ * @brief Remove all duplicate elements of a repeated field in a single step,
+ * elements are compared by their serialized form
+ * 
+ */
+class DedupTrimTask : public TrimTask {
+public:
+  /**
+   * @brief returns true if the repeated `field` of `msg` contains duplicates
+   * 
+   */
+  static bool HasDuplicates(const google::protobuf::Message &msg, 
+                            const google::protobuf::FieldDescriptor &field);
+
+  DedupTrimTask(google::protobuf::Message &msg, 
+                const google::protobuf::FieldDescriptor &field, 
+                std::string path) :
+    TrimTask(msg, field, path, -1) {}
+
+  bool restructures() const override {
+    return true;
+  }
+
+  void Trim() override;
+};
+
+
+/**
+ * @brief Remove all fields that are usually redundant in a single step
+ * 
+ */
+class BulkTrimTask : public TrimTask {
+public:
+  typedef std::pair<google::protobuf::Message *, 
+                    const google::protobuf::FieldDescriptor *> Target;
+
+private:
+  std::vector<Target> targets;
+
+public:
+  /**
+   * @brief Construct a new BulkTrimTask. Targets must be in depth-first
+   * order, they are cleared in reverse so that nested fields are removed
+   * before their parents.
+   * 
+   * @param targets the fields to clear
+   * @param path the unique identifier for the task
+   */
+  BulkTrimTask(std::vector<Target> targets, std::string path) :
+    TrimTask(*targets.front().first, *targets.front().second, path, -1),
+    targets(std::move(targets)) {}
+
+  bool restructures() const override {
+    return true;
+  }
+
+  void Trim() override;
+
+  void Record(TrimHistory &history, bool success) override {
+    // A failure cannot be attributed to any single field
+    if (!success)
+      return;
+
+    for (const Target &target : targets)
+      history.Record(*target.second, true);
+  }
 };
 
 
@@ -161,20 +391,35 @@ private:
   std::unique_ptr<google::protobuf::Message> pmsg;
   std::stack<std::shared_ptr<TrimTask>> tasks;
   std::set<std::string> processed;
+  std::unordered_map<std::string, ChunkTrimTask::Cursor> cursors;
   std::vector<uint8_t> buf;
+  std::vector<BulkTrimTask::Target> bulk;
+  std::vector<std::shared_ptr<TrimTask>> dedups;
+  std::shared_ptr<TrimTask> last;
+  TrimHistory *history;
   TrimType trim_type_ = TrimType::NODES;
 
   struct FieldInfo {
     std::string &rootpath;
     google::protobuf::Message &msg;
     const google::protobuf::FieldDescriptor &field;
+    const FieldEntry &entry;
   };
 
 public:
   typedef std::pair<std::string, google::protobuf::Message&> MessageStackE;
   typedef std::stack<MessageStackE> MessageStack;
 
-  Trimmer(std::unique_ptr<google::protobuf::Message> message);
+  /**
+   * @brief Construct a new Trimmer for `message`.
+   * 
+   * @param message the message to be trimmed
+   * @param history optional trim history shared across sessions
+   */
+  Trimmer(std::unique_ptr<google::protobuf::Message> message, 
+          TrimHistory *history = nullptr);
+
+  ~Trimmer();
 
   bool done() const {
     return trim_type_ == TrimType::NONE;
@@ -226,6 +471,18 @@ private:
    * @param info information about the protobuf field
    */
   void CreateTask(MessageStack &accumulator, const FieldInfo &info);
+
+  /**
+   * @brief Returns true if a NODES task for `field` should be created
+   * 
+   */
+  bool ShouldCreateNodeTask(const google::protobuf::FieldDescriptor &field);
+
+  /**
+   * @brief Records the last TrimOne() as successful if it was not reverted
+   * 
+   */
+  void Settle();
 };
 
 }
\ No newline at end of file
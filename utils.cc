@@ -1,4 +1,8 @@
 #include <cmath>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "utils.hh"
 
@@ -8,4 +12,35 @@ std::size_t NextPow2(std::size_t n) {
   return std::pow(2, std::ceil(std::log(n) / std::log(2)));
 }
 
+
+MappedFile::~MappedFile() {
+  if (data_)
+    munmap(const_cast<uint8_t *>(data_), size_);
+}
+
+
+bool MappedFile::Open(const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    return false;
+  }
+
+  void *mem = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mem == MAP_FAILED)
+    return false;
+
+  if (data_)
+    munmap(const_cast<uint8_t *>(data_), size_);
+
+  data_ = static_cast<const uint8_t *>(mem);
+  size_ = st.st_size;
+  return true;
+}
+
 }
\ No newline at end of file
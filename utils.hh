@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <concepts>
 #include <google/protobuf/message.h>
@@ -19,4 +20,35 @@ inline std::string Serialize(const google::protobuf::Message &proto) {
 
 std::size_t NextPow2(std::size_t n);
 
+
+/**
+ * @brief A read-only, private mapping of a whole file
+ * 
+ */
+class MappedFile {
+private:
+  const uint8_t *data_ = nullptr;
+  std::size_t size_ = 0;
+
+public:
+  MappedFile() = default;
+  MappedFile(const MappedFile &) = delete;
+  MappedFile& operator=(const MappedFile &) = delete;
+  ~MappedFile();
+
+  /**
+   * @brief maps `path`, returns false if it cannot be opened or is empty
+   * 
+   */
+  bool Open(const char *path);
+
+  const uint8_t * data() const {
+    return data_;
+  }
+
+  std::size_t size() const {
+    return size_;
+  }
+};
+
 };
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <google/protobuf/descriptor.h>
+
+namespace lpmpp {
+
+/**
+ * @brief Compile-time layout of a field, as emitted by protoc-gen-lpmpp
+ * 
+ */
+struct FieldLayout {
+  int number;
+  google::protobuf::FieldDescriptor::Type type;
+  bool repeated;
+  // Index of the containing oneof, or -1
+  int oneof;
+};
+
+
+/**
+ * @brief Type-specific field visitors for generated message classes. The 
+ * primary template is used for types without generated traits, which take
+ * the reflection paths instead.
+ * 
+ * Specializations are generated by protoc-gen-lpmpp into <file>.lpmpp.hh 
+ * and provide a constexpr field count and layout, and a Visit function 
+ * which calls the generated accessors of every set field:
+ * 
+ *   v.Value(field, value, set)   numeric and bool fields, `set` stores a new value
+ *   v.Enum(field, number, set)   enum fields, `set` stores a new number
+ *   v.String(field, str)         string and bytes fields, by reference
+ *   v.Message(field, msg)        message fields, by reference
+ * 
+ * Map fields and extensions are not visited.
+ */
+template<typename T>
+struct MessageTraits {
+  static constexpr bool kSpecialized = false;
+};
+
+template<typename T>
+concept Specialized = MessageTraits<T>::kSpecialized;
+
+
+/**
+ * @brief Visits the fields of `msg` with `v`, visitors call this from 
+ * Message to descend into submessages
+ * 
+ */
+template<typename T, typename V>
+void VisitTyped(T &msg, V &v) {
+  MessageTraits<T>::Visit(msg, v);
+}
+
+}
@@ -0,0 +1,179 @@
+#include <cstring>
+
+#include "wire.hh"
+
+using namespace google::protobuf;
+
+namespace lpmpp {
+
+WireType WireTypeOf(const FieldDescriptor &field) {
+  switch (field.type()) {
+    case FieldDescriptor::TYPE_DOUBLE:
+    case FieldDescriptor::TYPE_FIXED64:
+    case FieldDescriptor::TYPE_SFIXED64:
+      return WIRE_FIXED64;
+    case FieldDescriptor::TYPE_FLOAT:
+    case FieldDescriptor::TYPE_FIXED32:
+    case FieldDescriptor::TYPE_SFIXED32:
+      return WIRE_FIXED32;
+    case FieldDescriptor::TYPE_STRING:
+    case FieldDescriptor::TYPE_BYTES:
+    case FieldDescriptor::TYPE_MESSAGE:
+      return WIRE_LEN;
+    case FieldDescriptor::TYPE_GROUP:
+      return WIRE_START_GROUP;
+    default:
+      return WIRE_VARINT;
+  }
+}
+
+/* -------------------------------------- */
+/* --- WireIndex method definitions ----- */
+/* -------------------------------------- */
+
+bool WireIndex::Build(const uint8_t *buf, std::size_t size, const Descriptor &root) {
+  if (type == &root && size == input.size() && memcmp(buf, input.data(), size) == 0)
+    return valid;
+
+  input.assign(reinterpret_cast<const char *>(buf), size);
+  type = &root;
+  fields.clear();
+  leaves.clear();
+
+  valid = size <= UINT32_MAX && Scan(0, size, root, -1, 0);
+  return valid;
+}
+
+
+bool WireIndex::Scan(uint32_t begin, uint32_t end, const Descriptor &msg, int32_t parent, 
+  int depth) {
+  
+  if (depth > kMaxWireDepth)
+    return false;
+
+  const uint8_t *base = data();
+  const uint8_t *p = base + begin;
+  const uint8_t *e = base + end;
+
+  while (p < e) {
+    const uint32_t tag = p - base;
+    uint64_t key;
+    if (!(p = ReadVarint(p, e, key)) || key >> 3 == 0 || key >> 3 > UINT32_MAX)
+      return false;
+
+    const uint32_t body = p - base;
+    uint64_t size;
+
+    switch (key & 7) {
+      case WIRE_VARINT: {
+        uint64_t value;
+        const uint8_t *next = ReadVarint(p, e, value);
+        if (!next)
+          return false;
+        size = next - p;
+        break;
+      }
+      case WIRE_FIXED64:
+        size = 8;
+        break;
+      case WIRE_FIXED32:
+        size = 4;
+        break;
+      case WIRE_LEN:
+        if (!(p = ReadVarint(p, e, size)))
+          return false;
+        break;
+      default:
+        return false;
+    }
+
+    if (size > static_cast<uint64_t>(e - p))
+      return false;
+
+    const uint32_t value = p - base;
+    p += size;
+
+    // Unknown fields and packed repeated fields are left as they are
+    const FieldDescriptor *field = msg.FindFieldByNumber(key >> 3);
+    if (!field || WireTypeOf(*field) != static_cast<WireType>(key & 7))
+      continue;
+
+    const int32_t self = fields.size();
+    fields.push_back(WireField{field, tag, body, value, static_cast<uint32_t>(size), parent});
+
+    if (field->cpp_type() != FieldDescriptor::CPPTYPE_MESSAGE) {
+      leaves.push_back(self);
+    } else if (!Scan(value, value + size, *field->message_type(), self, depth + 1)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+std::size_t WireIndex::BodySize(const WireField &leaf, std::size_t value_size) const {
+  return WireTypeOf(*leaf.field) == WIRE_LEN ? VarintSize(value_size) + value_size : value_size;
+}
+
+
+std::size_t WireIndex::RewrittenSize(const WireField &leaf, std::size_t value_size) const {
+  int64_t growth = static_cast<int64_t>(BodySize(leaf, value_size)) - (leaf.value + leaf.size - leaf.body);
+
+  for (int32_t i = leaf.parent; i >= 0; i = fields[i].parent) {
+    const WireField &msg = fields[i];
+    const uint64_t size = msg.size + growth;
+    growth += static_cast<int64_t>(VarintSize(size)) - (msg.value - msg.body);
+  }
+
+  return input.size() + growth;
+}
+
+
+std::size_t WireIndex::Rewrite(const WireField &leaf, const uint8_t *value, std::size_t value_size, 
+  std::vector<uint8_t> &out) const {
+  
+  // New lengths of the enclosing messages, innermost first
+  const WireField *chain[kMaxWireDepth + 1];
+  uint64_t sizes[kMaxWireDepth + 1];
+  int depth = 0;
+  int64_t growth = static_cast<int64_t>(BodySize(leaf, value_size)) - (leaf.value + leaf.size - leaf.body);
+
+  for (int32_t i = leaf.parent; i >= 0; i = fields[i].parent) {
+    const WireField &msg = fields[i];
+    chain[depth] = &msg;
+    sizes[depth] = msg.size + growth;
+    growth += static_cast<int64_t>(VarintSize(sizes[depth])) - (msg.value - msg.body);
+    depth++;
+  }
+
+  const std::size_t total = input.size() + growth;
+  if (out.size() < total)
+    out.resize(total);
+
+  const uint8_t *in = data();
+  uint8_t *o = out.data();
+  uint32_t pos = 0;
+
+  // Copy up to each length prefix, outermost first, and write the new one
+  while (depth-- > 0) {
+    const WireField &msg = *chain[depth];
+    memcpy(o, in + pos, msg.body - pos);
+    o += msg.body - pos;
+    o += WriteVarint(sizes[depth], o);
+    pos = msg.value;
+  }
+
+  memcpy(o, in + pos, leaf.body - pos);
+  o += leaf.body - pos;
+  if (WireTypeOf(*leaf.field) == WIRE_LEN)
+    o += WriteVarint(value_size, o);
+  memcpy(o, value, value_size);
+  o += value_size;
+
+  pos = leaf.value + leaf.size;
+  memcpy(o, in + pos, input.size() - pos);
+  return total;
+}
+
+}
@@ -0,0 +1,190 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <google/protobuf/descriptor.h>
+
+namespace lpmpp {
+
+// Share of value replacements applied to the serialized input directly,
+// overridden by LPMPP_WIRE_SHARE between 0 and 1
+static const char * const kWireShareEnv = "LPMPP_WIRE_SHARE";
+static const double kWireShare = 0.5;
+// Deepest nesting indexed, as the default recursion limit of protobuf
+static const int kMaxWireDepth = 100;
+// Longest varint, a negative int32 is sign-extended to 10 bytes
+static const std::size_t kMaxVarintSize = 10;
+
+enum WireType {
+  WIRE_VARINT = 0,
+  WIRE_FIXED64 = 1,
+  WIRE_LEN = 2,
+  WIRE_START_GROUP = 3,
+  WIRE_END_GROUP = 4,
+  WIRE_FIXED32 = 5,
+};
+
+
+/**
+ * @brief Reads a varint from [`p`, `end`) into `value`, returns the byte
+ * after it or nullptr if it is truncated or too long
+ * 
+ */
+inline const uint8_t * ReadVarint(const uint8_t *p, const uint8_t *end, uint64_t &value) {
+  value = 0;
+  for (int shift = 0; p < end && shift < 64; shift += 7) {
+    const uint8_t byte = *p++;
+    value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if (!(byte & 0x80))
+      return p;
+  }
+
+  return nullptr;
+}
+
+/**
+ * @brief Writes `value` as a varint to `out`, returns the number of bytes
+ * written, at most kMaxVarintSize
+ * 
+ */
+inline std::size_t WriteVarint(uint64_t value, uint8_t *out) {
+  std::size_t n = 0;
+  while (value >= 0x80) {
+    out[n++] = static_cast<uint8_t>(value) | 0x80;
+    value >>= 7;
+  }
+  out[n++] = static_cast<uint8_t>(value);
+  return n;
+}
+
+inline std::size_t VarintSize(uint64_t value) {
+  std::size_t n = 1;
+  while (value >= 0x80) {
+    value >>= 7;
+    n++;
+  }
+  return n;
+}
+
+inline uint64_t ZigZagEncode(int64_t value) {
+  return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+inline int64_t ZigZagDecode(uint64_t value) {
+  return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+/**
+ * @brief Reads a little-endian fixed32 or fixed64 of `size` bytes
+ * 
+ */
+inline uint64_t LoadFixed(const uint8_t *p, std::size_t size) {
+  uint64_t value = 0;
+  for (std::size_t i = 0; i < size; i++)
+    value |= static_cast<uint64_t>(p[i]) << (8 * i);
+  return value;
+}
+
+inline void StoreFixed(uint64_t value, uint8_t *p, std::size_t size) {
+  for (std::size_t i = 0; i < size; i++)
+    p[i] = static_cast<uint8_t>(value >> (8 * i));
+}
+
+/**
+ * @brief returns the wire type of the values of `field`, unpacked
+ * 
+ */
+WireType WireTypeOf(const google::protobuf::FieldDescriptor &field);
+
+
+/**
+ * @brief A field found in the serialized input. Message fields enclose the
+ * fields after them up to their end.
+ * 
+ */
+struct WireField {
+  const google::protobuf::FieldDescriptor *field;
+  // Offsets of the tag, of the length prefix or value after it and of the
+  // value itself
+  uint32_t tag;
+  uint32_t body;
+  uint32_t value;
+  uint32_t size;
+  // Index of the enclosing message field, -1 at the root
+  int32_t parent;
+};
+
+
+/**
+ * @brief Index of the fields of a serialized message, built in a single
+ * pass over the wire format without parsing it into a message. Leaves are
+ * the known scalar, string and bytes fields, which can be rewritten in the
+ * serialized input by patching the length prefixes of the enclosing
+ * messages. The index of the last input is kept, as AFL++ calls fuzz many
+ * times in a row with the same queue entry.
+ * 
+ */
+class WireIndex {
+private:
+  std::string input;
+  const google::protobuf::Descriptor *type = nullptr;
+  bool valid = false;
+  std::vector<WireField> fields;
+  std::vector<uint32_t> leaves;
+
+public:
+  /**
+   * @brief Indexes `buf`, a serialized `root`. Returns false if it is not
+   * well-formed, or uses groups.
+   * 
+   */
+  bool Build(const uint8_t *buf, std::size_t size, const google::protobuf::Descriptor &root);
+
+  /**
+   * @brief Writes the indexed input to `out`, with the value of `leaf`
+   * replaced by `value` and the length prefixes of the enclosing messages
+   * patched. `value` is the varint, fixed or length-delimited payload
+   * according to the wire type of the field.
+   * 
+   * @return the size of the output
+   */
+  std::size_t Rewrite(const WireField &leaf, const uint8_t *value, std::size_t value_size,
+                      std::vector<uint8_t> &out) const;
+
+  /**
+   * @brief returns the size of the output of Rewrite
+   * 
+   */
+  std::size_t RewrittenSize(const WireField &leaf, std::size_t value_size) const;
+
+  const uint8_t * data() const {
+    return reinterpret_cast<const uint8_t *>(input.data());
+  }
+
+  std::size_t size() const {
+    return input.size();
+  }
+
+  const std::vector<WireField> & entries() const {
+    return fields;
+  }
+
+  const std::vector<uint32_t> & leaf_entries() const {
+    return leaves;
+  }
+
+private:
+  bool Scan(uint32_t begin, uint32_t end, const google::protobuf::Descriptor &msg,
+            int32_t parent, int depth);
+
+  /**
+   * @brief returns the size of `leaf` once its value is `value_size` bytes
+   * long, including its length prefix
+   * 
+   */
+  std::size_t BodySize(const WireField &leaf, std::size_t value_size) const;
+};
+
+}